@@ -0,0 +1,635 @@
+//
+//  main.mm
+//  RXPromise Benchmarks
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+//
+//  Usage: rxpromise-bench [-r repetitions] [-n max_n] [-f filter]
+//
+//  Each benchmark prints one JSON object per line to stdout:
+//
+//  {"benchmark":<name>,"n":<n>,"samples":<count>,"ops_per_sec":<number>,"p50_ns":<number>,"p99_ns":<number>}
+//
+//  `ops_per_sec` is the number of operations (e.g. handlers executed) per
+//  second over all repetitions, `p50_ns` and `p99_ns` are percentiles of the
+//  latency samples of the benchmark, which are described at each benchmark.
+//
+//  The benchmark `then_allocations` prints the number of allocations per
+//  `then` with pooling disabled and enabled instead:
+//
+//  {"benchmark":"then_allocations","n":<n>,"pooling":<bool>,"allocations_per_then":<number>}
+//
+//  When compiled with RXPROMISE_BENCH_BASELINE defined as 1, the suite builds
+//  against the sources of the baseline version (see `make compare`), and the
+//  benchmarks of features which did not exist then will be skipped.
+
+#if !__has_feature(objc_arc)
+#error this file requires arc enabled
+#endif
+
+#import <Foundation/Foundation.h>
+#import <RXPromise/RXPromise.h>
+#include <dispatch/dispatch.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <new>
+#include <unistd.h>
+
+
+#if !defined (RXPROMISE_BENCH_BASELINE)
+#define RXPROMISE_BENCH_BASELINE 0
+#endif
+
+
+// Counts the allocations of C++ objects, which include the records of the
+// library that are subject to pooling. Objects and blocks allocated by the
+// Objective-C runtime are not counted.
+static std::atomic<uint64_t> cxx_allocations(0);
+
+void* operator new(std::size_t size) {
+    cxx_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+
+namespace {
+
+    inline uint64_t now_ns() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+
+    struct options {
+        options() : repetitions(10), max_n(1000000) {}
+
+        int             repetitions;
+        std::size_t     max_n;
+        std::string     filter;
+    };
+
+
+    // Collects the latency samples of one benchmark and prints the result.
+    class result {
+    public:
+        result(std::string const& name, std::size_t n)
+        : name_(name), n_(n), operations_(0), elapsed_(0)
+        {}
+
+        // Adds one latency sample in nanoseconds.
+        void sample(double ns) {
+            samples_.push_back(ns);
+        }
+
+        // Adds the number of operations which have been executed in
+        // `elapsed` nanoseconds.
+        void operations(double count, uint64_t elapsed) {
+            operations_ += count;
+            elapsed_ += elapsed;
+        }
+
+        void report() {
+            double ops_per_sec = elapsed_ ? operations_ * 1e9 / elapsed_ : 0;
+            printf("{\"benchmark\":\"%s\",\"n\":%zu,\"samples\":%zu,\"ops_per_sec\":%.1f,\"p50_ns\":%.1f,\"p99_ns\":%.1f}\n",
+                   name_.c_str(), n_, samples_.size(), ops_per_sec, percentile(0.50), percentile(0.99));
+            fflush(stdout);
+        }
+
+    private:
+        double percentile(double p) {
+            if (samples_.empty()) {
+                return 0;
+            }
+            std::size_t k = std::min(samples_.size() - 1, (std::size_t)(p * samples_.size()));
+            std::nth_element(samples_.begin(), samples_.begin() + k, samples_.end());
+            return samples_[k];
+        }
+
+        std::string         name_;
+        std::size_t         n_;
+        double              operations_;
+        uint64_t            elapsed_;
+        std::vector<double> samples_;
+    };
+
+
+    bool selected(options const& opts, std::string const& name) {
+        return opts.filter.empty() || name.find(opts.filter) != std::string::npos;
+    }
+
+
+    // The number of repetitions for a benchmark with `n` operations per
+    // repetition, such that large benchmarks do not take too long.
+    int repetitions_for(options const& opts, std::size_t n) {
+        std::size_t r = std::max<std::size_t>(1, 1000000 / std::max<std::size_t>(n, 1));
+        return (int)std::min<std::size_t>(opts.repetitions, r);
+    }
+
+
+    std::vector<std::size_t> sizes(options const& opts) {
+        std::vector<std::size_t> result;
+        for (std::size_t n = 10; n <= opts.max_n; n *= 10) {
+            result.push_back(n);
+        }
+        return result;
+    }
+
+
+    typedef RXPromise* (^register_block_t)(RXPromise* promise);
+
+
+    // Chain latency: builds a chain of `length` handlers on a pending root,
+    // resolves the root and waits for the last promise. A sample is the time
+    // per step of the chain.
+    void bench_chain(options const& opts, std::string const& name, std::size_t length, register_block_t reg) {
+        if (!selected(opts, name)) {
+            return;
+        }
+        result r(name, length);
+        for (int i = 0; i < opts.repetitions; ++i) {
+            @autoreleasepool {
+                RXPromise* root = [[RXPromise alloc] init];
+                RXPromise* promise = root;
+                for (std::size_t j = 0; j < length; ++j) {
+                    promise = reg(promise);
+                }
+                uint64_t t0 = now_ns();
+                [root fulfillWithValue:@"OK"];
+                [promise wait];
+                uint64_t t1 = now_ns();
+                r.sample((double)(t1 - t0) / length);
+                r.operations(length, t1 - t0);
+            }
+        }
+        r.report();
+    }
+
+
+    // Fan-out: registers `n` handlers on one pending promise, resolves it and
+    // waits until all handlers have been executed. A sample is the time from
+    // resolving the promise until the last handler has been executed.
+    void bench_fan_out(options const& opts, std::size_t n) {
+        if (!selected(opts, "fan_out")) {
+            return;
+        }
+        result r("fan_out", n);
+        for (int i = 0, count = repetitions_for(opts, n); i < count; ++i) {
+            @autoreleasepool {
+                RXPromise* promise = [[RXPromise alloc] init];
+                dispatch_semaphore_t sem = dispatch_semaphore_create(0);
+                std::atomic<std::size_t>* pending = new std::atomic<std::size_t>(n);
+                for (std::size_t j = 0; j < n; ++j) {
+                    promise.then(^id(id result) {
+                        if (pending->fetch_sub(1) == 1) {
+                            dispatch_semaphore_signal(sem);
+                        }
+                        return nil;
+                    }, nil);
+                }
+                uint64_t t0 = now_ns();
+                [promise fulfillWithValue:@"OK"];
+                dispatch_semaphore_wait(sem, DISPATCH_TIME_FOREVER);
+                uint64_t t1 = now_ns();
+                delete pending;
+                r.sample((double)(t1 - t0));
+                r.operations(n, t1 - t0);
+            }
+        }
+        r.report();
+    }
+
+
+    typedef RXPromise* (^combinator_t)(NSArray* promises);
+
+
+    // Combinators: creates `n` pending promises, applies the combinator,
+    // resolves the promises and waits for the combined promise. A sample is
+    // the time from applying the combinator until it has been resolved.
+    void bench_combinator(options const& opts, std::string const& name, std::size_t n, combinator_t combinator) {
+        if (!selected(opts, name)) {
+            return;
+        }
+        result r(name, n);
+        for (int i = 0, count = repetitions_for(opts, n); i < count; ++i) {
+            @autoreleasepool {
+                NSMutableArray* promises = [[NSMutableArray alloc] initWithCapacity:n];
+                for (std::size_t j = 0; j < n; ++j) {
+                    [promises addObject:[[RXPromise alloc] init]];
+                }
+                uint64_t t0 = now_ns();
+                RXPromise* combined = combinator(promises);
+                for (RXPromise* promise in promises) {
+                    [promise fulfillWithValue:@"OK"];
+                }
+                [combined wait];
+                uint64_t t1 = now_ns();
+                r.sample((double)(t1 - t0));
+                r.operations(n, t1 - t0);
+            }
+        }
+        r.report();
+    }
+
+
+    // Sequence: runs `sequence:task:` over `n` inputs with a task returning a
+    // resolved promise. A sample is the time per input.
+    void bench_sequence(options const& opts, std::size_t n) {
+        if (!selected(opts, "sequence")) {
+            return;
+        }
+        result r("sequence", n);
+        NSMutableArray* inputs = [[NSMutableArray alloc] initWithCapacity:n];
+        for (std::size_t j = 0; j < n; ++j) {
+            [inputs addObject:@(j)];
+        }
+        for (int i = 0, count = repetitions_for(opts, n); i < count; ++i) {
+            @autoreleasepool {
+                uint64_t t0 = now_ns();
+                [[RXPromise sequence:inputs task:^RXPromise*(id input) {
+                    return [RXPromise promiseWithResult:input];
+                }] wait];
+                uint64_t t1 = now_ns();
+                r.sample((double)(t1 - t0) / n);
+                r.operations(n, t1 - t0);
+            }
+        }
+        r.report();
+    }
+
+
+    // Cancel propagation: builds a chain of `length` handlers on a pending
+    // root, cancels the root and waits for the last promise. A sample is the
+    // time per step of the chain.
+    void bench_cancel_propagation(options const& opts, std::size_t length) {
+        if (!selected(opts, "cancel_propagation")) {
+            return;
+        }
+        result r("cancel_propagation", length);
+        for (int i = 0; i < opts.repetitions; ++i) {
+            @autoreleasepool {
+                RXPromise* root = [[RXPromise alloc] init];
+                RXPromise* promise = root;
+                for (std::size_t j = 0; j < length; ++j) {
+                    promise = promise.then(nil, nil);
+                }
+                uint64_t t0 = now_ns();
+                [root cancel];
+                [promise wait];
+                uint64_t t1 = now_ns();
+                r.sample((double)(t1 - t0) / length);
+                r.operations(length, t1 - t0);
+            }
+        }
+        r.report();
+    }
+
+
+    // Wake-up latency: a thread blocks in `wait` while another thread resolves
+    // the promise. A sample is the time from resolving until the waiting
+    // thread continues.
+    void bench_wait_wakeup(options const& opts) {
+        if (!selected(opts, "wait_wakeup")) {
+            return;
+        }
+        const int count = opts.repetitions * 100;
+        result r("wait_wakeup", 1);
+        for (int i = 0; i < count; ++i) {
+            @autoreleasepool {
+                RXPromise* promise = [[RXPromise alloc] init];
+                std::atomic<uint64_t>* t0 = new std::atomic<uint64_t>(0);
+                dispatch_async(dispatch_get_global_queue(0, 0), ^{
+                    usleep(100);
+                    t0->store(now_ns());
+                    [promise fulfillWithValue:@"OK"];
+                });
+                [promise wait];
+                uint64_t t1 = now_ns();
+                r.sample((double)(t1 - t0->load()));
+                r.operations(1, t1 - t0->load());
+                delete t0;
+            }
+        }
+        r.report();
+    }
+
+
+    // Contention: several threads concurrently register handlers on and
+    // resolve the same `n` promises. A sample is the time per operation of
+    // one thread.
+    void bench_contention(options const& opts, std::size_t n) {
+        if (!selected(opts, "contention")) {
+            return;
+        }
+        unsigned thread_count = std::max(2u, std::thread::hardware_concurrency());
+        result r("contention", n);
+        for (int i = 0, count = repetitions_for(opts, n); i < count; ++i) {
+            @autoreleasepool {
+                NSMutableArray* promises = [[NSMutableArray alloc] initWithCapacity:n];
+                for (std::size_t j = 0; j < n; ++j) {
+                    [promises addObject:[[RXPromise alloc] init]];
+                }
+                std::vector<uint64_t> elapsed(thread_count);
+                std::vector<std::thread> threads;
+                uint64_t t0 = now_ns();
+                for (unsigned t = 0; t < thread_count; ++t) {
+                    threads.emplace_back([&elapsed, promises, t, n]() {
+                        @autoreleasepool {
+                            uint64_t start = now_ns();
+                            for (std::size_t j = 0; j < n; ++j) {
+                                RXPromise* promise = promises[j];
+                                if (t % 2) {
+                                    [promise fulfillWithValue:@"OK"];
+                                }
+                                else {
+                                    promise.then(nil, nil);
+                                }
+                            }
+                            elapsed[t] = now_ns() - start;
+                        }
+                    });
+                }
+                for (std::thread& thread : threads) {
+                    thread.join();
+                }
+                uint64_t t1 = now_ns();
+                for (uint64_t e : elapsed) {
+                    r.sample((double)e / n);
+                }
+                r.operations((double)n * thread_count, t1 - t0);
+            }
+        }
+        r.report();
+    }
+
+
+    // Release latency: releases `n` resolved promises, each with a child. A
+    // sample is the time per released promise. The children will be registered
+    // with `then`, which the baseline supports, too, and all handlers will have
+    // finished before the promises will be released.
+    void bench_release(options const& opts, std::size_t n) {
+        if (!selected(opts, "release")) {
+            return;
+        }
+        result r("release", n);
+        for (int i = 0, count = std::max(1, opts.repetitions / 5); i < count; ++i) {
+            NSMutableArray* promises = [[NSMutableArray alloc] initWithCapacity:2*n];
+            @autoreleasepool {
+                for (std::size_t j = 0; j < n; ++j) {
+                    RXPromise* promise = [[RXPromise alloc] init];
+                    RXPromise* child = promise.then(nil, nil);
+                    [promises addObject:promise];
+                    [promises addObject:child];
+                    [promise fulfillWithValue:@"OK"];
+                }
+                for (RXPromise* promise in promises) {
+                    [promise wait];
+                }
+            }
+            uint64_t t0 = now_ns();
+            promises = nil;
+            uint64_t t1 = now_ns();
+            r.sample((double)(t1 - t0) / (2*n));
+            r.operations(2*n, t1 - t0);
+        }
+        r.report();
+    }
+
+
+    // Timeouts: sets a timeout on `n` pending promises, then resolves them,
+    // which cancels the timeouts. Reports the cost of creating the timeouts
+    // and of cancelling them; samples are the time per timeout.
+    void bench_timeout(options const& opts, std::size_t n) {
+        if (!selected(opts, "timeout")) {
+            return;
+        }
+        result create("timeout_create", n);
+        result cancel("timeout_cancel", n);
+        for (int i = 0, count = std::max(1, opts.repetitions / 5); i < count; ++i) {
+            @autoreleasepool {
+                NSMutableArray* promises = [[NSMutableArray alloc] initWithCapacity:n];
+                for (std::size_t j = 0; j < n; ++j) {
+                    [promises addObject:[[RXPromise alloc] init]];
+                }
+                uint64_t t0 = now_ns();
+                for (RXPromise* promise in promises) {
+                    [promise setTimeout:60];
+                }
+                uint64_t t1 = now_ns();
+                for (RXPromise* promise in promises) {
+                    [promise fulfillWithValue:@"OK"];
+                }
+                uint64_t t2 = now_ns();
+                create.sample((double)(t1 - t0) / n);
+                create.operations(n, t1 - t0);
+                cancel.sample((double)(t2 - t1) / n);
+                cancel.operations(n, t2 - t1);
+            }
+        }
+        create.report();
+        cancel.report();
+    }
+
+
+    // Timeouts with one dispatch timer source per promise, the approach of
+    // `setTimeout:` before the shared timer wheel, as the baseline for
+    // `bench_timeout`. Resolving a promise cancels its source in a handler;
+    // the cancel cost includes executing these handlers.
+    void bench_timeout_dispatch_source(options const& opts, std::size_t n) {
+        if (!selected(opts, "timeout")) {
+            return;
+        }
+        result create("timeout_dispatch_source_create", n);
+        result cancel("timeout_dispatch_source_cancel", n);
+        dispatch_queue_t queue = dispatch_queue_create("RXPromise.bench.timer_queue", NULL);
+        for (int i = 0, count = std::max(1, opts.repetitions / 5); i < count; ++i) {
+            @autoreleasepool {
+                NSMutableArray* promises = [[NSMutableArray alloc] initWithCapacity:n];
+                for (std::size_t j = 0; j < n; ++j) {
+                    [promises addObject:[[RXPromise alloc] init]];
+                }
+                dispatch_semaphore_t sem = dispatch_semaphore_create(0);
+                std::atomic<std::size_t>* pending = new std::atomic<std::size_t>(n);
+                uint64_t t0 = now_ns();
+                for (RXPromise* promise in promises) {
+                    dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+                    __weak RXPromise* weakPromise = promise;
+                    dispatch_source_set_event_handler(timer, ^{
+                        dispatch_source_cancel(timer);
+                        [weakPromise rejectWithReason:@"timeout"];
+                    });
+                    dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, 60 * (int64_t)NSEC_PER_SEC), DISPATCH_TIME_FOREVER, 0);
+                    dispatch_resume(timer);
+                    promise.thenOn(queue, ^id(id result) {
+                        dispatch_source_cancel(timer);
+                        if (pending->fetch_sub(1) == 1) {
+                            dispatch_semaphore_signal(sem);
+                        }
+                        return nil;
+                    }, nil);
+                }
+                uint64_t t1 = now_ns();
+                for (RXPromise* promise in promises) {
+                    [promise fulfillWithValue:@"OK"];
+                }
+                dispatch_semaphore_wait(sem, DISPATCH_TIME_FOREVER);
+                uint64_t t2 = now_ns();
+                delete pending;
+                create.sample((double)(t1 - t0) / n);
+                create.operations(n, t1 - t0);
+                cancel.sample((double)(t2 - t1) / n);
+                cancel.operations(n, t2 - t1);
+            }
+        }
+        create.report();
+        cancel.report();
+    }
+
+
+    // Allocations per `then`: builds chains of `length` handlers like
+    // `bench_chain`, resolves them and releases them, with pooling disabled
+    // and enabled. Reports the number of C++ allocations per `then`, see
+    // `cxx_allocations`. The first chain of each mode warms up the pools and
+    // will not be counted. The baseline has no pools.
+    void bench_then_allocations(options const& opts, std::size_t length) {
+        if (!selected(opts, "then_allocations")) {
+            return;
+        }
+        for (bool pooling : {false, true}) {
+#if RXPROMISE_BENCH_BASELINE
+            if (pooling) {
+                continue;
+            }
+#else
+            [RXPromise setPoolingEnabled:pooling];
+#endif
+            uint64_t allocations = 0;
+            for (int i = 0; i <= opts.repetitions; ++i) {
+                uint64_t a0 = cxx_allocations.load(std::memory_order_relaxed);
+                @autoreleasepool {
+                    RXPromise* root = [[RXPromise alloc] init];
+                    RXPromise* promise = root;
+                    for (std::size_t j = 0; j < length; ++j) {
+                        promise = promise.then(^id(id result) { return result; }, nil);
+                    }
+                    [root fulfillWithValue:@"OK"];
+                    [promise wait];
+                }
+                uint64_t a1 = cxx_allocations.load(std::memory_order_relaxed);
+                if (i > 0) {
+                    allocations += a1 - a0;
+                }
+            }
+            printf("{\"benchmark\":\"then_allocations\",\"n\":%zu,\"pooling\":%s,\"allocations_per_then\":%.2f}\n",
+                   length, pooling ? "true" : "false", (double)allocations / ((double)length * opts.repetitions));
+            fflush(stdout);
+        }
+#if !RXPROMISE_BENCH_BASELINE
+        [RXPromise setPoolingEnabled:NO];
+#endif
+    }
+
+
+    void usage(char const* name) {
+        fprintf(stderr, "usage: %s [-r repetitions] [-n max_n] [-f filter]\n", name);
+    }
+
+}
+
+
+int main(int argc, char const* argv[]) {
+    options opts;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            opts.repetitions = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            opts.max_n = (std::size_t)std::max(10L, atol(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            opts.filter = argv[++i];
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    @autoreleasepool {
+        dispatch_queue_t serial_queue = dispatch_queue_create("RXPromise.bench.serial_queue", NULL);
+
+        bench_chain(opts, "chain_then", 1000, ^RXPromise*(RXPromise* promise) {
+            return promise.then(^id(id result) { return result; }, nil);
+        });
+        bench_chain(opts, "chain_then_on", 1000, ^RXPromise*(RXPromise* promise) {
+            return promise.thenOn(serial_queue, ^id(id result) { return result; }, nil);
+        });
+#if !RXPROMISE_BENCH_BASELINE
+        bench_chain(opts, "chain_then_inline", 1000, ^RXPromise*(RXPromise* promise) {
+            return promise.thenInline(^id(id result) { return result; }, nil);
+        });
+        // The overhead of collecting statistics, which is enabled by default:
+        for (BOOL enabled : {NO, YES}) {
+            [RXPromise setStatisticsEnabled:enabled];
+            bench_chain(opts, enabled ? "chain_then_statistics_enabled" : "chain_then_statistics_disabled", 1000, ^RXPromise*(RXPromise* promise) {
+                return promise.then(^id(id result) { return result; }, nil);
+            });
+        }
+        [RXPromise setStatisticsEnabled:YES];
+#endif
+
+        for (std::size_t n : {10, 1000, 100000}) {
+            bench_fan_out(opts, n);
+        }
+
+        for (std::size_t n : sizes(opts)) {
+            bench_combinator(opts, "all", n, ^RXPromise*(NSArray* promises) {
+                return [RXPromise all:promises];
+            });
+            bench_combinator(opts, "allSettled", n, ^RXPromise*(NSArray* promises) {
+                return [RXPromise allSettled:promises];
+            });
+            bench_combinator(opts, "any", n, ^RXPromise*(NSArray* promises) {
+                return [RXPromise any:promises];
+            });
+        }
+
+        for (std::size_t n : {1000, 100000}) {
+            bench_sequence(opts, n);
+        }
+
+        bench_cancel_propagation(opts, 1000);
+        bench_wait_wakeup(opts);
+        bench_contention(opts, 100000);
+        bench_release(opts, std::min<std::size_t>(opts.max_n, 1000000));
+        bench_timeout(opts, std::min<std::size_t>(opts.max_n, 100000));
+        bench_timeout_dispatch_source(opts, std::min<std::size_t>(opts.max_n, 100000));
+        bench_then_allocations(opts, 1000);
+    }
+    return 0;
+}
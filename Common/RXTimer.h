@@ -39,6 +39,12 @@ typedef void (^RXTimerHandler)(RXTimer* timer);
  will have a significant positive impact on the power usage of your application.
  The system may put a maximum value of the tolerance.
  
+ The timer is backed by a timer wheel which is shared by all timers. It fires
+ no earlier than the scheduled fire date, and at the latest one tick
+ (\c RXPROMISE_TIMER_TICK) plus the leeway (\c RXPROMISE_TIMER_LEEWAY) of the
+ timer wheel after the scheduled fire date. Thus, currently the tolerance is
+ ignored.
+ 
  
  @param: delay The delay in seconds after the timer will fire
  
@@ -0,0 +1,111 @@
+//
+//  RXTimer.m
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#import "RXTimer.h"
+#include "../Source/utility/timer_service.h"
+#include <atomic>
+
+
+namespace {
+    enum timer_state { Idle, Started, Fired, Cancelled };
+    
+    typedef rxpromise::timer_service::timer service_timer;
+    
+    // Marks a timer which has fired before `start` stored it.
+    inline service_timer* firedTimer() {
+        return reinterpret_cast<service_timer*>(uintptr_t(0x1));
+    }
+    
+    inline void releaseTimer(service_timer* timer) {
+        if (timer && timer != firedTimer()) {
+            rxpromise::timer_service::shared().cancel(timer);
+        }
+    }
+}
+
+
+@interface RXTimer ()
+@end
+
+@implementation RXTimer {
+    dispatch_queue_t    _queue;
+    RXTimerHandler      _block;
+    uint64_t            _interval;
+    std::atomic<int>    _state;
+    std::atomic<service_timer*> _timer;
+}
+
+
+- (id) initWithTimeIntervalSinceNow:(NSTimeInterval)delay
+                          tolorance:(double)tolerance
+                              queue:(dispatch_queue_t)queue
+                              block:(RXTimerHandler)block;
+{
+    self = [super init];
+    if (self) {
+        _interval = delay * NSEC_PER_SEC;
+        _queue = queue;
+        _block = block;
+        _state.store(Idle);
+        _timer.store(nullptr);
+    }
+    return self;
+}
+
+- (void) dealloc {
+    releaseTimer(_timer.exchange(nullptr));
+}
+
+
+
+// Invoking this method has no effect if the timer has already been started or
+// canceled.
+- (void) start {
+    int expected = Idle;
+    if (!_state.compare_exchange_strong(expected, Started)) {
+        return;
+    }
+    // The timer retains the receiver until it fires or it will be cancelled:
+    service_timer* timer = rxpromise::timer_service::shared().schedule(_interval, ^{
+        releaseTimer(_timer.exchange(firedTimer()));
+        dispatch_async(_queue, ^{
+            int started = Started;
+            if (_state.compare_exchange_strong(started, Fired) && _block) {
+                _block(self);
+            }
+        });
+    });
+    if (_timer.exchange(timer) == firedTimer() || _state.load() != Started) {
+        // The timer has already fired, or it has been cancelled while it was
+        // being started:
+        releaseTimer(_timer.exchange(firedTimer()));
+    }
+}
+
+- (void) cancel {
+    int state = _state.load();
+    while ((state == Idle || state == Started) && !_state.compare_exchange_weak(state, Cancelled)) {
+    }
+    releaseTimer(_timer.exchange(nullptr));
+}
+
+- (BOOL) isValid {
+    int state = _state.load();
+    return state == Idle || state == Started;
+}
+
+@end
@@ -0,0 +1,122 @@
+//
+//  RXBatcher.h
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+@class RXPromise;
+
+
+/* Synopsis
+
+ typedef RXPromise* (^rxp_batch_task_t)(NSArray* keys);
+
+ @interface RXBatcher : NSObject
+
+ - (instancetype) initWithMaxBatchSize:(NSUInteger)maxBatchSize
+                                window:(NSTimeInterval)window
+                                  task:(rxp_batch_task_t)task;
+
+ - (RXPromise*) load:(id<NSCopying>)key;
+ - (void) flush;
+
+ @property (nonatomic, readonly) NSUInteger maxBatchSize;
+ @property (nonatomic, readonly) NSTimeInterval window;
+
+ @end
+
+ */
+
+
+/**
+ @brief The type of the batch task of a \c RXBatcher.
+
+ @param keys The distinct keys of the batch, in the order they have been first
+ requested.
+
+ @return A promise which will be fulfilled with either a \c NSArray containing one
+ result for each key, in the order of \p keys, or a \c NSDictionary mapping the
+ keys to their results. A result which is a \c NSError rejects the promises of
+ its key.
+ */
+typedef RXPromise* (^rxp_batch_task_t)(NSArray* keys);
+
+
+/**
+ @brief A batcher coalesces individual requests for keys into batches, and
+ invokes one batch task per batch.
+
+ @discussion A batch will be started when it contains \p maxBatchSize distinct
+ keys, when the window elapsed after the first key has been requested, or when
+ \p flush will be invoked. The batch task will be invoked on the default concurrent
+ queue. When its promise will be resolved, the promise returned from \p load:
+ will be fulfilled with the result of its key, or rejected with the error of
+ its key or the error of the batch.
+
+ @par Requesting the same key more than once within one batch requests it only
+ once from the batch task. Results will not be cached across batches.
+
+ @par Cancelling a promise returned from \p load: does not affect its batch.
+
+ @par All methods are thread-safe. When a batcher will be deallocated, a pending
+ batch will be started immediately.
+ */
+@interface RXBatcher : NSObject
+
+/**
+ @brief Initializes a batcher.
+
+ @param maxBatchSize The maximum number of distinct keys of a batch. Zero means
+ unlimited.
+
+ @param window The time in seconds a batch collects keys after its first key has
+ been requested. If zero, a batch collects the keys requested until the default
+ concurrent queue executes the next block.
+
+ @param task The batch task.
+ */
+- (instancetype) initWithMaxBatchSize:(NSUInteger)maxBatchSize
+                               window:(NSTimeInterval)window
+                                 task:(rxp_batch_task_t)task;
+
+
+/**
+ @brief Requests the result for a key.
+
+ @return A new promise which will be resolved when the batch containing the key
+ has been completed.
+ */
+- (RXPromise*) load:(id<NSCopying>)key;
+
+
+/**
+ @brief Starts the pending batch immediately, if any.
+ */
+- (void) flush;
+
+
+/**
+ @brief The maximum number of distinct keys of a batch. Zero means unlimited.
+ */
+@property (nonatomic, readonly) NSUInteger maxBatchSize;
+
+
+/**
+ @brief The time in seconds a batch collects keys.
+ */
+@property (nonatomic, readonly) NSTimeInterval window;
+
+@end
@@ -0,0 +1,234 @@
+//
+//  RXBatcher.mm
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+
+#if (!__has_feature(objc_arc))
+#error this file requires arc enabled
+#endif
+
+#import "RXBatcher.h"
+#import "RXPromise.h"
+#import "RXPromise+Private.h"
+#include "utility/timer_service.h"
+#include <mutex>
+
+
+namespace {
+
+    // The keys of one batch, and the promises of each key.
+    struct batch {
+        NSMutableArray*         keys;       // distinct keys
+        NSMutableArray*         promises;   // for each key, a NSMutableArray of promises
+        NSMutableDictionary*    index;      // key -> index in `keys`
+        rxpromise::timer_service::timer* timer;
+    };
+
+
+    void settle(NSArray* promises, id result) {
+        for (RXPromise* promise in promises) {
+            if ([result isKindOfClass:[NSError class]]) {
+                [promise rejectWithReason:result];
+            }
+            else {
+                [promise fulfillWithValue:result];
+            }
+        }
+    }
+
+
+    // Invokes the task with the keys of the batch and settles the promises of
+    // the batch with its results. Does not reference the batcher, so that a
+    // batch can still run after the batcher has been deallocated.
+    void run(batch b, rxp_batch_task_t task) {
+        if (b.timer) {
+            rxpromise::timer_service::shared().cancel(b.timer);
+        }
+        NSArray* keys = b.keys;
+        NSArray* promises = b.promises;
+        rxpromise::dispatch_to_execution_context(nil, ^{
+            RXPromise* batchPromise = task(keys);
+            if (batchPromise == nil) {
+                batchPromise = [[RXPromise alloc] init];
+                [batchPromise rejectWithReason:@"invalid batch result"];
+            }
+            [batchPromise rxp_registerInlineOnSuccess:^id(id result) {
+                NSUInteger count = [keys count];
+                if ([result isKindOfClass:[NSArray class]] && [result count] == count) {
+                    for (NSUInteger i = 0; i < count; ++i) {
+                        settle(promises[i], result[i]);
+                    }
+                }
+                else if ([result isKindOfClass:[NSDictionary class]]) {
+                    for (NSUInteger i = 0; i < count; ++i) {
+                        id value = result[keys[i]];
+                        if (value == nil) {
+                            value = rxpromise::make_rejection_error(@"no result for key");
+                        }
+                        settle(promises[i], value);
+                    }
+                }
+                else {
+                    NSError* error = rxpromise::make_rejection_error(@"invalid batch result");
+                    for (NSArray* p in promises) {
+                        settle(p, error);
+                    }
+                }
+                return nil;
+            } onFailure:^id(NSError* error) {
+                for (NSArray* p in promises) {
+                    settle(p, error);
+                }
+                return nil;
+            }];
+        });
+    }
+
+}
+
+
+// Implementation notes:
+//
+// The pending batch is protected by `_mutex`. Each batch gets a generation
+// number, so that a timer which fires after its batch has already been started
+// has no effect. The window timers use the shared timer service of
+// `setTimeout:`, and the batch task will never be invoked while holding the
+// lock.
+@implementation RXBatcher {
+    std::mutex          _mutex;
+    batch               _batch;             // the pending batch, if `_batch.keys` is not nil
+    uint64_t            _generation;
+    NSUInteger          _maxBatchSize;
+    NSTimeInterval      _window;
+    rxp_batch_task_t    _task;
+}
+
+@synthesize maxBatchSize = _maxBatchSize;
+@synthesize window = _window;
+
+
+- (instancetype) initWithMaxBatchSize:(NSUInteger)maxBatchSize
+                               window:(NSTimeInterval)window
+                                 task:(rxp_batch_task_t)task
+{
+    NSParameterAssert(task);
+    self = [super init];
+    if (self) {
+        _maxBatchSize = maxBatchSize;
+        _window = window > 0 ? window : 0;
+        _task = [task copy];
+        _batch = batch{nil, nil, nil, nullptr};
+    }
+    return self;
+}
+
+
+- (void) dealloc {
+    // No timer can reference the receiver anymore, start the pending batch:
+    if (_batch.keys) {
+        run(_batch, _task);
+    }
+}
+
+
+- (RXPromise*) load:(id<NSCopying>)key {
+    NSParameterAssert(key);
+    RXPromise* promise = [[RXPromise alloc] init];
+    batch full = batch{nil, nil, nil, nullptr};
+    BOOL schedule = NO;
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_batch.keys == nil) {
+            _batch.keys = [[NSMutableArray alloc] init];
+            _batch.promises = [[NSMutableArray alloc] init];
+            _batch.index = [[NSMutableDictionary alloc] init];
+            ++_generation;
+            schedule = YES;
+        }
+        generation = _generation;
+        NSNumber* i = _batch.index[key];
+        if (i) {
+            [_batch.promises[[i unsignedIntegerValue]] addObject:promise];
+        }
+        else {
+            _batch.index[key] = @([_batch.keys count]);
+            [_batch.keys addObject:key];
+            [_batch.promises addObject:[NSMutableArray arrayWithObject:promise]];
+        }
+        if (_maxBatchSize != 0 && [_batch.keys count] >= _maxBatchSize) {
+            full = [self locked_takeBatch];
+            schedule = NO;
+        }
+        else if (schedule && _window > 0) {
+            // The timer will be cancelled when the batch will be started:
+            __weak RXBatcher* weakSelf = self;
+            _batch.timer = rxpromise::timer_service::shared().schedule((uint64_t)(_window * NSEC_PER_SEC), ^{
+                [weakSelf rxp_startBatch:generation];
+            });
+            schedule = NO;
+        }
+    }
+    if (full.keys) {
+        run(full, _task);
+    }
+    else if (schedule) {
+        __weak RXBatcher* weakSelf = self;
+        rxpromise::dispatch_to_execution_context(nil, ^{
+            [weakSelf rxp_startBatch:generation];
+        });
+    }
+    return promise;
+}
+
+
+- (void) flush {
+    batch b;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        b = [self locked_takeBatch];
+    }
+    if (b.keys) {
+        run(b, _task);
+    }
+}
+
+
+#pragma mark - Private
+
+// Requires the lock. Removes the pending batch and returns it.
+- (batch) locked_takeBatch {
+    batch b = _batch;
+    _batch = batch{nil, nil, nil, nullptr};
+    return b;
+}
+
+
+// Starts the pending batch if it is the batch with the given generation.
+- (void) rxp_startBatch:(uint64_t)generation {
+    batch b = batch{nil, nil, nil, nullptr};
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_batch.keys && _generation == generation) {
+            b = [self locked_takeBatch];
+        }
+    }
+    if (b.keys) {
+        run(b, _task);
+    }
+}
+
+@end
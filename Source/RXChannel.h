@@ -0,0 +1,137 @@
+//
+//  RXChannel.h
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+@class RXPromise;
+
+
+/* Synopsis
+
+ @interface RXChannel : NSObject
+
+ + (instancetype) channelWithCapacity:(NSUInteger)capacity;
+ - (instancetype) initWithCapacity:(NSUInteger)capacity;
+
+ - (RXPromise*) send:(id)value;
+ - (RXPromise*) receive;
+ - (void) close;
+
+ @property (nonatomic, readonly) NSUInteger capacity;
+ @property (nonatomic, readonly) NSUInteger count;
+ @property (nonatomic, readonly) BOOL isClosed;
+
+ @end
+
+ */
+
+
+/**
+ @brief A channel is a bounded first-in first-out queue which connects any number
+ of senders with any number of receivers.
+
+ @discussion Sending and receiving never block a thread. Instead, \p send: returns
+ a promise which will be fulfilled when the channel accepted the value, and
+ \p receive returns a promise which will be fulfilled with the next value. A
+ sender which does not send the next value until its previous value has been
+ accepted will be slowed down to the pace of the receivers.
+
+ @par A channel does not use a dispatch queue. Its state is protected by a lock
+ which is held only for a few instructions, and promises will be resolved after
+ the lock has been released.
+
+ @par All methods are thread-safe.
+ */
+@interface RXChannel : NSObject
+
+/**
+ @brief Returns a new channel with the given capacity.
+ */
++ (instancetype) channelWithCapacity:(NSUInteger)capacity;
+
+
+/**
+ @brief Initializes a channel which buffers up to \p capacity values.
+
+ @discussion If \p capacity equals zero, the channel is unbuffered: a value will
+ only be accepted when a receiver takes it.
+ */
+- (instancetype) initWithCapacity:(NSUInteger)capacity;
+
+
+/**
+ @brief Sends a value.
+
+ @discussion If a receiver is waiting, the value will be handed over to it.
+ Otherwise, if the buffer has space, the value will be buffered. Otherwise, the
+ value will be accepted as soon as a receiver takes a value.
+
+ If the returned promise will be cancelled before the value has been accepted,
+ the value will not be sent.
+
+ @param value The value. If \c nil, \c NSNull will be sent.
+
+ @return A promise which will be fulfilled with the value when it has been
+ accepted, or rejected with reason \c \@"channel closed" when the channel has
+ been closed before.
+ */
+- (RXPromise*) send:(id)value;
+
+
+/**
+ @brief Receives the next value.
+
+ @discussion Values will be received in the order they have been accepted, and
+ waiting receivers will be served in the order they called \p receive. If the
+ returned promise will be cancelled before a value is available, the receiver
+ will not take a value.
+
+ @return A promise which will be fulfilled with the next value, or rejected with
+ reason \c \@"channel closed" when the channel has been closed and all values
+ have been received.
+ */
+- (RXPromise*) receive;
+
+
+/**
+ @brief Closes the channel.
+
+ @discussion Subsequent sends will be rejected, as well as the sends which wait
+ for acceptance. The values which have already been accepted can still be
+ received. Then, pending and subsequent receives will be rejected.
+ */
+- (void) close;
+
+
+/**
+ @brief The maximum number of buffered values.
+ */
+@property (nonatomic, readonly) NSUInteger capacity;
+
+
+/**
+ @brief The number of buffered values.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+
+/**
+ @brief Returns \c YES if the channel has been closed.
+ */
+@property (nonatomic, readonly) BOOL isClosed;
+
+@end
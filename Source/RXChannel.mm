@@ -0,0 +1,322 @@
+//
+//  RXChannel.mm
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+
+#if (!__has_feature(objc_arc))
+#error this file requires arc enabled
+#endif
+
+#import "RXChannel.h"
+#import "RXPromise.h"
+#import "RXPromise+Private.h"
+#include <algorithm>
+#include <deque>
+#include <mutex>
+
+
+namespace {
+
+    struct waiting_sender {
+        id          value;
+        RXPromise*  promise;
+    };
+
+    RXPromise* closedPromise() {
+        RXPromise* promise = [[RXPromise alloc] init];
+        [promise rejectWithReason:@"channel closed"];
+        return promise;
+    }
+
+}
+
+
+// Implementation notes:
+//
+// All state is protected by `_mutex`, which will never be held while resolving
+// a promise, since resolving may execute inline handlers which call back into
+// the channel.
+//
+// Waiting senders and receivers remove themselves when their promise has been
+// cancelled. A promise which has been cancelled concurrently - after it has
+// been dequeued and before it has been fulfilled - will be detected when it
+// cannot be fulfilled anymore: a value taken for a cancelled receiver will be
+// handed to the next receiver or put back in front of the buffer, and the
+// value of a cancelled sender will be dropped and the next sender dequeued.
+@implementation RXChannel {
+    std::mutex                      _mutex;
+    std::deque<id>                  _buffer;
+    std::deque<waiting_sender>      _senders;
+    std::deque<RXPromise*>          _receivers;
+    NSUInteger                      _capacity;
+    BOOL                            _closed;
+}
+
+
++ (instancetype) channelWithCapacity:(NSUInteger)capacity {
+    return [[self alloc] initWithCapacity:capacity];
+}
+
+
+- (instancetype) init {
+    return [self initWithCapacity:0];
+}
+
+
+- (instancetype) initWithCapacity:(NSUInteger)capacity {
+    self = [super init];
+    if (self) {
+        _capacity = capacity;
+    }
+    return self;
+}
+
+
+- (RXPromise*) send:(id)value {
+    if (value == nil) {
+        value = [NSNull null];
+    }
+    RXPromise* receiver = nil;
+    RXPromise* promise = nil;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_closed) {
+            return closedPromise();
+        }
+        receiver = [self locked_dequeueReceiver];
+        if (receiver == nil) {
+            if (_buffer.size() < _capacity) {
+                _buffer.push_back(value);
+            }
+            else {
+                promise = [[RXPromise alloc] init];
+                _senders.push_back(waiting_sender{value, promise});
+            }
+        }
+    }
+    if (receiver) {
+        [self rxp_deliverValue:value toReceiver:receiver];
+    }
+    if (promise == nil) {
+        return [RXPromise promiseWithResult:value];
+    }
+    __weak RXChannel* weakSelf = self;
+    __weak RXPromise* weakPromise = promise;
+    [promise rxp_registerInlineOnSuccess:nil onFailure:^id(NSError* error) {
+        [weakSelf rxp_removeSender:weakPromise];
+        return nil;
+    }];
+    return promise;
+}
+
+
+- (RXPromise*) receive {
+    for (;;) {
+        id value = nil;
+        waiting_sender sender;
+        BOOL hasSender = NO;
+        RXPromise* promise = nil;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_buffer.empty()) {
+                value = _buffer.front();
+                _buffer.pop_front();
+            }
+            else if ([self locked_dequeueSender:&sender]) {
+                hasSender = YES;
+            }
+            else if (_closed) {
+                return closedPromise();
+            }
+            else {
+                promise = [[RXPromise alloc] init];
+                _receivers.push_back(promise);
+            }
+        }
+        if (value) {
+            [self rxp_acceptWaitingSender];
+            return [RXPromise promiseWithResult:value];
+        }
+        if (hasSender) {
+            // A sender which has been cancelled concurrently cannot be
+            // fulfilled anymore, and its value will not be received:
+            if ([sender.promise rxp_fulfillWithValue:sender.value]) {
+                return [RXPromise promiseWithResult:sender.value];
+            }
+            continue;
+        }
+        __weak RXChannel* weakSelf = self;
+        __weak RXPromise* weakPromise = promise;
+        [promise rxp_registerInlineOnSuccess:nil onFailure:^id(NSError* error) {
+            [weakSelf rxp_removeReceiver:weakPromise];
+            return nil;
+        }];
+        return promise;
+    }
+}
+
+
+- (void) close {
+    std::deque<waiting_sender> senders;
+    std::deque<RXPromise*> receivers;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_closed) {
+            return;
+        }
+        _closed = YES;
+        senders.swap(_senders);
+        // Waiting receivers imply an empty buffer:
+        receivers.swap(_receivers);
+    }
+    for (waiting_sender const& s : senders) {
+        [s.promise rejectWithReason:@"channel closed"];
+    }
+    for (RXPromise* receiver : receivers) {
+        [receiver rejectWithReason:@"channel closed"];
+    }
+}
+
+
+- (NSUInteger) capacity {
+    return _capacity;
+}
+
+
+- (NSUInteger) count {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _buffer.size();
+}
+
+
+- (BOOL) isClosed {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _closed;
+}
+
+
+- (NSString*) description {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return [NSString stringWithFormat:@"<%@:%p> { count: %lu, capacity: %lu, waiting senders: %lu, waiting receivers: %lu%@ }",
+            NSStringFromClass([self class]), (__bridge void*)self,
+            (unsigned long)_buffer.size(), (unsigned long)_capacity,
+            (unsigned long)_senders.size(), (unsigned long)_receivers.size(),
+            _closed ? @", closed" : @""];
+}
+
+
+#pragma mark - Private
+
+// Requires the lock. Returns the first waiting receiver which has not been
+// cancelled, or nil.
+- (RXPromise*) locked_dequeueReceiver {
+    while (!_receivers.empty()) {
+        RXPromise* receiver = _receivers.front();
+        _receivers.pop_front();
+        if (receiver.isPending) {
+            return receiver;
+        }
+    }
+    return nil;
+}
+
+
+// Requires the lock. Dequeues the first waiting sender which has not been
+// cancelled. Returns NO if there is none.
+- (BOOL) locked_dequeueSender:(waiting_sender*)sender {
+    while (!_senders.empty()) {
+        *sender = _senders.front();
+        _senders.pop_front();
+        if (sender->promise.isPending) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+
+// Fulfills the receiver with the value. If the receiver has been cancelled in
+// the meantime, the value will be passed to the next receiver, or put back in
+// front of the buffer - even when this temporarily exceeds the capacity.
+- (void) rxp_deliverValue:(id)value toReceiver:(RXPromise*)receiver {
+    while (![receiver rxp_fulfillWithValue:value]) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        receiver = [self locked_dequeueReceiver];
+        if (receiver == nil) {
+            _buffer.push_front(value);
+            return;
+        }
+    }
+}
+
+
+// Accepts the value of the first waiting sender if the buffer has space. The
+// value of a sender which has been cancelled in the meantime will be dropped,
+// and the next sender will be tried.
+- (void) rxp_acceptWaitingSender {
+    for (;;) {
+        waiting_sender sender;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_buffer.size() >= _capacity || ![self locked_dequeueSender:&sender]) {
+                return;
+            }
+        }
+        if ([sender.promise rxp_fulfillWithValue:sender.value]) {
+            [self rxp_acceptValue:sender.value];
+            return;
+        }
+    }
+}
+
+
+// Hands the accepted value over to the first waiting receiver, or appends it
+// to the buffer - even when a concurrent send has taken the free slot in the
+// meantime and this temporarily exceeds the capacity.
+- (void) rxp_acceptValue:(id)value {
+    RXPromise* receiver = nil;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        receiver = [self locked_dequeueReceiver];
+        if (receiver == nil) {
+            _buffer.push_back(value);
+            return;
+        }
+    }
+    [self rxp_deliverValue:value toReceiver:receiver];
+}
+
+
+- (void) rxp_removeSender:(RXPromise*)promise {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = std::find_if(_senders.begin(), _senders.end(), [promise](waiting_sender const& s) {
+        return s.promise == promise;
+    });
+    if (it != _senders.end()) {
+        _senders.erase(it);
+    }
+}
+
+
+- (void) rxp_removeReceiver:(RXPromise*)promise {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = std::find(_receivers.begin(), _receivers.end(), promise);
+    if (it != _receivers.end()) {
+        _receivers.erase(it);
+    }
+}
+
+@end
@@ -0,0 +1,289 @@
+//
+//  RXCoroutine.h
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+
+#ifndef RXPROMISE_RXCOROUTINE_H
+#define RXPROMISE_RXCOROUTINE_H
+
+/**
+ RXPROMISE_HAS_COROUTINES
+
+ Defined as 1 when the compiler supports C++20 coroutines in Objective-C++ and
+ the declarations of this header are available, otherwise defined as 0.
+ */
+#if defined (__cplusplus) && defined (__OBJC__) && defined (__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define RXPROMISE_HAS_COROUTINES 1
+#else
+#define RXPROMISE_HAS_COROUTINES 0
+#endif
+
+
+#if RXPROMISE_HAS_COROUTINES
+
+#import <Foundation/Foundation.h>
+#import "RXPromise.h"
+#include "RXFuture.h"
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+
+/* Synopsis
+
+ namespace rxpromise {
+
+     class awaitable {
+     public:
+         explicit awaitable(RXPromise* promise);    // resumes like `then`
+     };
+
+     awaitable resume_on(RXPromise* promise, id executionContext);
+     awaitable resume_inline(RXPromise* promise);
+
+     class task {
+     public:
+         RXPromise* promise() const;
+         operator RXPromise*() const;
+     };
+ }
+
+ */
+
+
+// Coroutines for Objective-C++ (C++20).
+//
+// A function whose return type is `rxpromise::task` is a coroutine which
+// produces a `RXPromise`. It starts immediately, runs until its first
+// suspension on the calling thread and then returns its promise. `co_await`
+// on a `RXPromise*` suspends the coroutine until the promise will be resolved
+// and yields its value; a rejection will be thrown as `rxpromise::objc_error`.
+// `co_return` resolves the returned promise like `resolveWithResult:`, and an
+// exception which leaves the coroutine rejects it. A multi-step flow therefore
+// allocates one coroutine frame, instead of a handler and a returned promise
+// for each step of a `then` chain:
+//
+//     rxpromise::task fetchUser(NSURL* url) {
+//         NSData* data = co_await download(url);
+//         id json = co_await rxpromise::resume_on(parse(data), queue);
+//         co_return [User userWithJSON:json];
+//     }
+//
+//     RXPromise* user = fetchUser(url);
+//
+// A plain `co_await promise` resumes the coroutine on the unspecified execution
+// context, like a handler registered with `then`. `resume_on` resumes it on the
+// given execution context, like `thenOn`, and `resume_inline` on the thread
+// which resolves the promise, like `thenInline`. If the awaited promise has
+// already been resolved, the coroutine may continue without suspending. A
+// resumed coroutine runs on that execution context until its next suspension.
+//
+// Cancelling the returned promise cancels the promise the coroutine currently
+// awaits, like a bound promise, and every later `co_await` of the coroutine
+// throws the cancellation error. Arguments should be passed by value, since
+// the coroutine outlives the caller's stack frame. A coroutine which awaits a
+// promise which will never be resolved will not be destroyed.
+//
+// An `awaitable` can also be awaited in other coroutine types.
+
+namespace rxpromise {
+
+    class task;
+
+
+    namespace detail {
+
+        // The state shared by a coroutine and the failure handler of the
+        // promise it returns.
+        struct task_state {
+            std::mutex  mutex;
+            RXPromise*  awaited = nil;      // the promise the coroutine awaits
+            NSError*    cancelled = nil;    // set when the returned promise has been rejected
+        };
+
+    }
+
+
+    class awaitable {
+    public:
+        explicit awaitable(RXPromise* promise)
+        : _promise(promise), _context(nil), _inline(false) {}
+
+        awaitable(RXPromise* promise, id executionContext, bool inlineExecution)
+        : _promise(promise), _context(executionContext), _inline(inlineExecution) {}
+
+        awaitable(awaitable const&) = delete;
+        awaitable& operator=(awaitable const&) = delete;
+
+        bool await_ready() const noexcept { return false; }
+
+        // Returns `false` if the handler has already been executed, so that the
+        // coroutine continues on the current thread instead of being resumed
+        // recursively.
+        bool await_suspend(std::coroutine_handle<> h) {
+            if (_state) {
+                std::lock_guard<std::mutex> lock(_state->mutex);
+                if (_state->cancelled) {
+                    _error = _state->cancelled;
+                    return false;
+                }
+                _state->awaited = _promise;
+            }
+            promise_completionHandler_t onSuccess = ^id(id result) {
+                _result = result;
+                complete(h);
+                return nil;
+            };
+            promise_errorHandler_t onFailure = ^id(NSError* error) {
+                _error = error;
+                complete(h);
+                return nil;
+            };
+            if (_inline) {
+                (void)_promise.thenInline(onSuccess, onFailure);
+            }
+            else if (_context) {
+                (void)_promise.thenOn(_context, onSuccess, onFailure);
+            }
+            else {
+                (void)_promise.then(onSuccess, onFailure);
+            }
+            return !_completed.exchange(true, std::memory_order_acq_rel);
+        }
+
+        id await_resume() {
+            if (_state) {
+                std::lock_guard<std::mutex> lock(_state->mutex);
+                if (_state->awaited == _promise) {
+                    _state->awaited = nil;
+                }
+            }
+            if (_error) {
+                throw objc_error(_error);
+            }
+            return _result;
+        }
+
+    private:
+        friend class task;
+
+        awaitable(RXPromise* promise, id executionContext, bool inlineExecution,
+                  std::shared_ptr<detail::task_state> const& state)
+        : _promise(promise), _context(executionContext), _inline(inlineExecution), _state(state) {}
+
+        // The first of the handler and `await_suspend` to complete leaves the
+        // resumption to the other one.
+        void complete(std::coroutine_handle<> h) {
+            if (_completed.exchange(true, std::memory_order_acq_rel)) {
+                h.resume();
+            }
+        }
+
+        RXPromise*                          _promise;
+        id                                  _context;
+        bool                                _inline;
+        std::shared_ptr<detail::task_state> _state;
+        std::atomic<bool>                   _completed{false};
+        id                                  _result = nil;
+        NSError*                            _error = nil;
+    };
+
+
+    // Awaits the promise and resumes the coroutine on the execution context, which
+    // is a dispatch queue, a NSOperationQueue or a NSThread, like `thenOn`.
+    inline awaitable resume_on(RXPromise* promise, id executionContext) {
+        return awaitable(promise, executionContext, false);
+    }
+
+    // Awaits the promise and resumes the coroutine on the thread which resolves
+    // the promise, like `thenInline`. The coroutine should then only do a short
+    // amount of work before it suspends or returns.
+    inline awaitable resume_inline(RXPromise* promise) {
+        return awaitable(promise, nil, true);
+    }
+
+
+    class task {
+    public:
+        struct promise_type {
+            promise_type()
+            : _promise([[RXPromise alloc] init]), _state(std::make_shared<detail::task_state>())
+            {
+                std::shared_ptr<detail::task_state> state = _state;
+                (void)_promise.thenInline(nil, ^id(NSError* error) {
+                    RXPromise* awaited;
+                    {
+                        std::lock_guard<std::mutex> lock(state->mutex);
+                        state->cancelled = error;
+                        awaited = state->awaited;
+                        state->awaited = nil;
+                    }
+                    [awaited cancelWithReason:error];
+                    return nil;
+                });
+            }
+
+            task get_return_object() { return task(_promise); }
+
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+
+            void return_value(id result) { [_promise resolveWithResult:result]; }
+
+            void unhandled_exception() {
+                [_promise rejectWithReason:detail::make_nserror(std::current_exception())];
+            }
+
+            awaitable await_transform(RXPromise* promise) {
+                return awaitable(promise, nil, false, _state);
+            }
+
+            awaitable& await_transform(awaitable& a) {
+                a._state = _state;
+                return a;
+            }
+
+            awaitable&& await_transform(awaitable&& a) {
+                a._state = _state;
+                return std::move(a);
+            }
+
+            template <typename A>
+            A&& await_transform(A&& a) { return std::forward<A>(a); }
+
+        private:
+            RXPromise*                          _promise;
+            std::shared_ptr<detail::task_state> _state;
+        };
+
+        // The promise which will be resolved with the result of the coroutine.
+        RXPromise* promise() const { return _promise; }
+        operator RXPromise*() const { return _promise; }
+
+    private:
+        explicit task(RXPromise* promise) : _promise(promise) {}
+
+        RXPromise* _promise;
+    };
+
+}
+
+#endif // RXPROMISE_HAS_COROUTINES
+
+#endif // RXPROMISE_RXCOROUTINE_H
@@ -0,0 +1,750 @@
+//
+//  RXFuture.h
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+
+#ifndef RXPROMISE_RXFUTURE_H
+#define RXPROMISE_RXFUTURE_H
+
+#if defined (__cplusplus)
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#if defined (__OBJC__)
+#import <Foundation/Foundation.h>
+#import "RXPromise.h"
+#endif
+
+
+/* Synopsis
+
+ namespace rxpromise {
+
+     template <typename T> class promise {
+     public:
+         promise();
+         future<T> get_future();
+         void set_value(T value);        // set_value() for T = void
+         void set_exception(std::exception_ptr error);
+         void set_error(std::error_code error);
+     };
+
+     template <typename T> class future {
+     public:
+         bool valid() const;
+         bool is_ready() const;
+         template <typename F> future<R> then(F&& f);        // R = f(T), or U if f returns future<U>
+         template <typename F> future<T> recover(F&& f);     // f(std::exception_ptr) -> T
+         T get();
+     };
+
+     template <typename T> future<T> make_ready_future(T value);
+     template <typename T> future<T> make_exceptional_future(std::exception_ptr error);
+
+     // Objective-C++ only:
+     struct objc_error;
+     future<id> make_future(RXPromise* promise);
+     template <typename T, typename F> RXPromise* make_rxpromise(future<T>&& f, F&& box);
+     RXPromise* make_rxpromise(future<id>&& f);
+ }
+
+ */
+
+
+// A typed, header-only promise and future for C++ code.
+//
+// A `promise<T>` is the producer side, a `future<T>` the consumer side of one
+// asynchronous result, which is either a value of type `T` or an exception.
+// Values will be moved, never copied, and are not boxed into objects. A future
+// is move-only and has at most one continuation, registered with `then` or
+// `recover`. A promise which will be destroyed without a result rejects its
+// future with a `std::future_error` of `std::future_errc::broken_promise`. A continuation runs on the thread which sets the result, or
+// immediately on the registering thread if the result is already available.
+// Continuations should therefore be short; a continuation which must run on a
+// certain queue can dispatch itself.
+//
+// An exception thrown from a continuation rejects the future returned from
+// `then`. A continuation which returns a `future<U>` will be flattened into a
+// `future<U>`.
+//
+// The shared state uses no lock: the result and the continuation meet with one
+// atomic exchange each. The continuation is stored in the shared state as a
+// type-erased node which owns the function and the promise of the returned
+// future. A `then` or `recover` therefore allocates two objects: that node and
+// the shared state of the returned future.
+//
+// In Objective-C++, `make_future` and `make_rxpromise` convert between futures
+// and `RXPromise` objects.
+
+namespace rxpromise {
+
+    template <typename T> class promise;
+    template <typename T> class future;
+
+
+    namespace detail {
+
+        // The type which stores the value of a `void` future.
+        struct unit {};
+
+        template <typename T> struct storage_type { typedef T type; };
+        template <> struct storage_type<void> { typedef unit type; };
+
+        template <typename T> struct is_future : std::false_type {};
+        template <typename T> struct is_future<future<T>> : std::true_type {};
+
+        template <typename T> struct unwrap_future { typedef T type; };
+        template <typename T> struct unwrap_future<future<T>> { typedef T type; };
+
+        template <typename T> class shared_state;
+
+
+        // A continuation of a shared state. It will be allocated once, when it
+        // is registered, and destroyed after it has been invoked, or with the
+        // shared state if it never will be.
+        template <typename T>
+        struct continuation_base {
+            virtual ~continuation_base() {}
+            virtual void invoke(shared_state<T>& s) = 0;
+        };
+
+        template <typename T, typename F>
+        struct continuation : continuation_base<T> {
+            template <typename G>
+            explicit continuation(G&& g) : f(std::forward<G>(g)) {}
+            void invoke(shared_state<T>& s) override { f(s); }
+            F f;
+        };
+
+
+        // The state shared by a promise and its future.
+        //
+        // `status_` transitions from `empty` to either `ready` or `waiting`,
+        // and from there to `done`. The party which makes the transition to
+        // `done` - either the producer setting the result or the consumer
+        // registering the continuation - runs the continuation.
+        template <typename T>
+        class shared_state {
+        public:
+            typedef typename storage_type<T>::type value_type;
+
+            shared_state() : status_(empty), has_value_(false), continuation_(nullptr) {}
+
+            ~shared_state() {
+                delete continuation_;
+                if (has_value_) {
+                    value().~value_type();
+                }
+            }
+
+            shared_state(shared_state const&) = delete;
+            shared_state& operator=(shared_state const&) = delete;
+
+            void set_value(value_type&& v) {
+                ::new (static_cast<void*>(&storage_)) value_type(std::move(v));
+                has_value_ = true;
+                publish();
+            }
+
+            void set_exception(std::exception_ptr e) {
+                error_ = std::move(e);
+                publish();
+            }
+
+            // Sets the continuation, a function object which will be invoked
+            // exactly once with this state after the result has been set.
+            template <typename F>
+            void set_continuation(F&& f) {
+                continuation_ = new continuation<T, typename std::decay<F>::type>(std::forward<F>(f));
+                int expected = empty;
+                if (!status_.compare_exchange_strong(expected, waiting, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                    assert(expected == ready);
+                    status_.store(done, std::memory_order_relaxed);
+                    run();
+                }
+            }
+
+            bool is_ready() const {
+                int s = status_.load(std::memory_order_acquire);
+                return s == ready || s == done;
+            }
+
+            // Requires that the result has been set.
+            bool has_value() const { return has_value_; }
+            value_type& value() { return *reinterpret_cast<value_type*>(&storage_); }
+            std::exception_ptr const& exception() const { return error_; }
+
+        private:
+            enum { empty, ready, waiting, done };
+
+            void publish() {
+                int expected = empty;
+                if (!status_.compare_exchange_strong(expected, ready, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                    assert(expected == waiting);
+                    status_.store(done, std::memory_order_relaxed);
+                    run();
+                }
+            }
+
+            void run() {
+                std::unique_ptr<continuation_base<T>> c(continuation_);
+                continuation_ = nullptr;
+                c->invoke(*this);
+            }
+
+            std::atomic<int>    status_;
+            bool                has_value_;
+            typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type storage_;
+            std::exception_ptr  error_;
+            continuation_base<T>* continuation_;
+        };
+
+
+        // Invokes `f` and resolves `p` with its result, or with the exception
+        // thrown from `f`. An exception thrown while resolving `p` - that is,
+        // from a continuation of `p` - will be propagated.
+        template <typename R>
+        struct invoker {
+            template <typename F, typename... Args>
+            static void call(promise<R>& p, F& f, Args&&... args) {
+                bool invoked = false;
+                try {
+                    R result = f(std::forward<Args>(args)...);
+                    invoked = true;
+                    p.set_value(std::move(result));
+                }
+                catch (...) {
+                    if (invoked) {
+                        throw;
+                    }
+                    p.set_exception(std::current_exception());
+                }
+            }
+        };
+
+        template <>
+        struct invoker<void> {
+            template <typename F, typename... Args>
+            static void call(promise<void>& p, F& f, Args&&... args);
+        };
+
+
+        // Passes the value of a state to functions and promises. A `void`
+        // state has no value to pass.
+        template <typename T>
+        struct access {
+            template <typename F>
+            static auto call(F& f, shared_state<T>& s) -> decltype(f(std::move(s.value()))) {
+                return f(std::move(s.value()));
+            }
+            template <typename R, typename F>
+            static void resolve(promise<R>& p, F& f, shared_state<T>& s) {
+                invoker<R>::call(p, f, std::move(s.value()));
+            }
+            static void forward(promise<T>& p, shared_state<T>& s);
+            static T take(shared_state<T>& s) { return std::move(s.value()); }
+        };
+
+        template <>
+        struct access<void> {
+            template <typename F>
+            static auto call(F& f, shared_state<void>&) -> decltype(f()) {
+                return f();
+            }
+            template <typename R, typename F>
+            static void resolve(promise<R>& p, F& f, shared_state<void>&) {
+                invoker<R>::call(p, f);
+            }
+            static void forward(promise<void>& p, shared_state<void>&);
+            static void take(shared_state<void>&) {}
+        };
+
+
+        template <typename T, typename F, bool Void = std::is_void<T>::value>
+        struct continuation_result {
+            typedef decltype(std::declval<F&>()(std::declval<T&&>())) type;
+        };
+
+        template <typename T, typename F>
+        struct continuation_result<T, F, true> {
+            typedef decltype(std::declval<F&>()()) type;
+        };
+
+
+        // The continuations registered by `future`. Each one owns the promise
+        // of the future returned from `then` or `recover`.
+
+        // Resolves the promise with the result of `f`.
+        template <typename T, typename R, typename F>
+        struct then_continuation {
+            promise<R> p;
+            F f;
+            void operator()(shared_state<T>& s) {
+                if (!s.has_value()) {
+                    p.set_exception(s.exception());
+                }
+                else {
+                    access<T>::resolve(p, f, s);
+                }
+            }
+        };
+
+        // Resolves the promise with the result of the state.
+        template <typename T>
+        struct forward_continuation {
+            promise<T> p;
+            void operator()(shared_state<T>& s) {
+                if (s.has_value()) {
+                    access<T>::forward(p, s);
+                }
+                else {
+                    p.set_exception(s.exception());
+                }
+            }
+        };
+
+        // Resolves the promise with the result of the future returned from `f`.
+        template <typename T, typename U, typename F>
+        struct flatten_continuation {
+            promise<U> p;
+            F f;
+            void operator()(shared_state<T>& s);
+        };
+
+        // Resolves the promise with the value, or with the result of `f`.
+        template <typename T, typename F>
+        struct recover_continuation {
+            promise<T> p;
+            F f;
+            void operator()(shared_state<T>& s) {
+                if (s.has_value()) {
+                    access<T>::forward(p, s);
+                }
+                else {
+                    invoker<T>::call(p, f, std::exception_ptr(s.exception()));
+                }
+            }
+        };
+
+    }
+
+
+    template <typename T>
+    class future {
+    public:
+        typedef T value_type;
+
+        future() = default;
+        future(future&&) = default;
+        future& operator=(future&&) = default;
+        future(future const&) = delete;
+        future& operator=(future const&) = delete;
+
+        // Returns true if the future refers to a shared state, that is, it
+        // has been obtained from a promise and has not been consumed.
+        bool valid() const { return state_ != nullptr; }
+
+        // Returns true if the result is available.
+        bool is_ready() const { return state_ && state_->is_ready(); }
+
+        // Registers a continuation which will be invoked with the value, and
+        // returns a future of its result. If this future will be rejected,
+        // the returned future will be rejected with the same exception. The
+        // receiver will be consumed.
+        template <typename F>
+        future<typename detail::unwrap_future<typename detail::continuation_result<T, typename std::decay<F>::type>::type>::type>
+        then(F&& f) {
+            typedef typename std::decay<F>::type function_type;
+            typedef typename detail::continuation_result<T, function_type>::type result_type;
+            return then_impl<result_type>(function_type(std::forward<F>(f)), detail::is_future<result_type>());
+        }
+
+        // Registers a continuation which will be invoked with the exception
+        // if this future will be rejected, and whose result - or exception -
+        // becomes the result of the returned future. A value will be passed
+        // through. The receiver will be consumed.
+        template <typename F>
+        future<T> recover(F&& f) {
+            typedef typename std::decay<F>::type function_type;
+            assert(state_);
+            promise<T> p;
+            future<T> result = p.get_future();
+            std::shared_ptr<detail::shared_state<T>> keep = std::move(state_);
+            keep->set_continuation(detail::recover_continuation<T, function_type>{std::move(p), function_type(std::forward<F>(f))});
+            return result;
+        }
+
+        // Blocks the current thread until the result is available, and returns
+        // the value or throws the exception. The receiver will be consumed.
+        // Meant for tests and for code which is already running on a thread
+        // which may block.
+        T get() {
+            assert(state_);
+            std::shared_ptr<detail::shared_state<T>> s = std::move(state_);
+            if (!s->is_ready()) {
+                std::mutex m;
+                std::condition_variable cv;
+                bool ready = false;
+                s->set_continuation([&](detail::shared_state<T>&) {
+                    std::lock_guard<std::mutex> lock(m);
+                    ready = true;
+                    cv.notify_one();
+                });
+                std::unique_lock<std::mutex> lock(m);
+                cv.wait(lock, [&]{ return ready; });
+            }
+            if (!s->has_value()) {
+                std::rethrow_exception(s->exception());
+            }
+            return detail::access<T>::take(*s);
+        }
+
+    private:
+        template <typename U> friend class promise;
+        template <typename U> friend class future;
+        template <typename, typename, typename> friend struct detail::flatten_continuation;
+
+        explicit future(std::shared_ptr<detail::shared_state<T>> s) : state_(std::move(s)) {}
+
+        // The continuation returns a plain value.
+        template <typename R, typename F>
+        future<R> then_impl(F f, std::false_type) {
+            assert(state_);
+            promise<R> p;
+            future<R> result = p.get_future();
+            std::shared_ptr<detail::shared_state<T>> keep = std::move(state_);
+            keep->set_continuation(detail::then_continuation<T, R, F>{std::move(p), std::move(f)});
+            return result;
+        }
+
+        // The continuation returns a future, which will be flattened.
+        template <typename R, typename F>
+        future<typename R::value_type> then_impl(F f, std::true_type) {
+            typedef typename R::value_type U;
+            assert(state_);
+            promise<U> p;
+            future<U> result = p.get_future();
+            std::shared_ptr<detail::shared_state<T>> keep = std::move(state_);
+            keep->set_continuation(detail::flatten_continuation<T, U, F>{std::move(p), std::move(f)});
+            return result;
+        }
+
+        std::shared_ptr<detail::shared_state<T>> state_;
+    };
+
+
+    template <typename T>
+    class promise {
+    public:
+        promise() : state_(std::make_shared<detail::shared_state<T>>()), retrieved_(false), satisfied_(false) {}
+
+        // Breaks the promise if it has no result.
+        ~promise() { abandon(); }
+
+        promise(promise&&) = default;
+        promise& operator=(promise&& other) {
+            if (this != &other) {
+                abandon();
+                state_ = std::move(other.state_);
+                retrieved_ = other.retrieved_;
+                satisfied_ = other.satisfied_;
+            }
+            return *this;
+        }
+        promise(promise const&) = delete;
+        promise& operator=(promise const&) = delete;
+
+        // Returns the future of the promise. May be invoked only once.
+        future<T> get_future() {
+            assert(!retrieved_);
+            retrieved_ = true;
+            return future<T>(state_);
+        }
+
+        // Fulfills the promise. The result may be set only once.
+        void set_value(T value) {
+            assert(!satisfied_);
+            satisfied_ = true;
+            state_->set_value(std::move(value));
+        }
+
+        // Rejects the promise with an exception.
+        void set_exception(std::exception_ptr error) {
+            assert(!satisfied_);
+            satisfied_ = true;
+            state_->set_exception(std::move(error));
+        }
+
+        // Rejects the promise with a `std::system_error` of the error code.
+        void set_error(std::error_code error) {
+            set_exception(std::make_exception_ptr(std::system_error(error)));
+        }
+
+    private:
+        // Rejects the future with `broken_promise` unless the result has been
+        // set. A moved-from promise has no state.
+        void abandon() {
+            if (state_ && !satisfied_) {
+                satisfied_ = true;
+                state_->set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+            }
+        }
+
+        std::shared_ptr<detail::shared_state<T>> state_;
+        bool retrieved_;
+        bool satisfied_;
+    };
+
+
+    template <>
+    class promise<void> {
+    public:
+        promise() : state_(std::make_shared<detail::shared_state<void>>()), retrieved_(false), satisfied_(false) {}
+
+        ~promise() { abandon(); }
+
+        promise(promise&&) = default;
+        promise& operator=(promise&& other) {
+            if (this != &other) {
+                abandon();
+                state_ = std::move(other.state_);
+                retrieved_ = other.retrieved_;
+                satisfied_ = other.satisfied_;
+            }
+            return *this;
+        }
+        promise(promise const&) = delete;
+        promise& operator=(promise const&) = delete;
+
+        future<void> get_future() {
+            assert(!retrieved_);
+            retrieved_ = true;
+            return future<void>(state_);
+        }
+
+        void set_value() {
+            assert(!satisfied_);
+            satisfied_ = true;
+            state_->set_value(detail::unit());
+        }
+
+        void set_exception(std::exception_ptr error) {
+            assert(!satisfied_);
+            satisfied_ = true;
+            state_->set_exception(std::move(error));
+        }
+
+        void set_error(std::error_code error) {
+            set_exception(std::make_exception_ptr(std::system_error(error)));
+        }
+
+    private:
+        void abandon() {
+            if (state_ && !satisfied_) {
+                satisfied_ = true;
+                state_->set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+            }
+        }
+
+        std::shared_ptr<detail::shared_state<void>> state_;
+        bool retrieved_;
+        bool satisfied_;
+    };
+
+
+    namespace detail {
+
+        template <typename F, typename... Args>
+        inline void invoker<void>::call(promise<void>& p, F& f, Args&&... args) {
+            try { f(std::forward<Args>(args)...); } catch (...) { p.set_exception(std::current_exception()); return; }
+            p.set_value();
+        }
+
+        template <typename T>
+        inline void access<T>::forward(promise<T>& p, shared_state<T>& s) {
+            p.set_value(std::move(s.value()));
+        }
+
+        inline void access<void>::forward(promise<void>& p, shared_state<void>&) {
+            p.set_value();
+        }
+
+        template <typename T, typename U, typename F>
+        inline void flatten_continuation<T, U, F>::operator()(shared_state<T>& s) {
+            if (!s.has_value()) {
+                p.set_exception(s.exception());
+                return;
+            }
+            future<U> inner;
+            try {
+                inner = access<T>::call(f, s);
+            }
+            catch (...) {
+                p.set_exception(std::current_exception());
+                return;
+            }
+            if (!inner.valid()) {
+                p.set_exception(std::make_exception_ptr(std::future_error(std::future_errc::no_state)));
+                return;
+            }
+            std::shared_ptr<shared_state<U>> inner_state = std::move(inner.state_);
+            inner_state->set_continuation(forward_continuation<U>{std::move(p)});
+        }
+
+    }
+
+
+    template <typename T>
+    future<typename std::decay<T>::type> make_ready_future(T&& value) {
+        promise<typename std::decay<T>::type> p;
+        future<typename std::decay<T>::type> f = p.get_future();
+        p.set_value(std::forward<T>(value));
+        return f;
+    }
+
+    inline future<void> make_ready_future() {
+        promise<void> p;
+        future<void> f = p.get_future();
+        p.set_value();
+        return f;
+    }
+
+    template <typename T>
+    future<T> make_exceptional_future(std::exception_ptr error) {
+        promise<T> p;
+        future<T> f = p.get_future();
+        p.set_exception(std::move(error));
+        return f;
+    }
+
+
+#if defined (__OBJC__)
+
+    // The exception of a future which has been made from a rejected or
+    // cancelled `RXPromise`.
+    struct objc_error : std::exception {
+        explicit objc_error(NSError* e) : error(e) {}
+        char const* what() const noexcept override { return "RXPromise has been rejected"; }
+        NSError* error;
+    };
+
+
+    namespace detail {
+
+        // Returns the error reason of a `RXPromise` rejected with the exception.
+        inline NSError* make_nserror(std::exception_ptr const& e) {
+            try {
+                std::rethrow_exception(e);
+            }
+            catch (objc_error const& x) {
+                return x.error;
+            }
+            catch (std::system_error const& x) {
+                return [[NSError alloc] initWithDomain:@"RXPromise"
+                                                  code:x.code().value()
+                                              userInfo:@{NSLocalizedFailureReasonErrorKey: @(x.what())}];
+            }
+            catch (std::exception const& x) {
+                return [[NSError alloc] initWithDomain:@"RXPromise"
+                                                  code:-1000
+                                              userInfo:@{NSLocalizedFailureReasonErrorKey: @(x.what())}];
+            }
+            catch (...) {
+                return [[NSError alloc] initWithDomain:@"RXPromise"
+                                                  code:-1000
+                                              userInfo:@{NSLocalizedFailureReasonErrorKey: @"unknown exception"}];
+            }
+        }
+
+        // Registers handlers on the promise which will be executed on the
+        // thread which resolves it, like `thenInline`, but without creating a
+        // returned promise. Defined in RXPromise.mm.
+        void register_inline(RXPromise* promise, promise_completionHandler_t onSuccess, promise_errorHandler_t onFailure);
+
+        template <typename T>
+        inline RXPromise* attach_rejection(RXPromise* promise, future<T>&& f) {
+            f.recover([promise](std::exception_ptr e) {
+                [promise rejectWithReason:make_nserror(e)];
+            });
+            return promise;
+        }
+
+    }
+
+
+    // Returns a future which will be fulfilled with the value of the promise,
+    // or rejected with an `objc_error` holding the error reason of the promise
+    // when it will be rejected or cancelled. If the promise is nil, the future
+    // will be rejected with a `std::future_error` of `no_state`.
+    inline future<id> make_future(RXPromise* promise) {
+        if (promise == nil) {
+            return make_exceptional_future<id>(std::make_exception_ptr(std::future_error(std::future_errc::no_state)));
+        }
+        auto p = std::make_shared<rxpromise::promise<id>>();
+        future<id> f = p->get_future();
+        detail::register_inline(promise, ^id(id result) {
+            p->set_value(result);
+            return nil;
+        }, ^id(NSError* error) {
+            p->set_exception(std::make_exception_ptr(objc_error(error)));
+            return nil;
+        });
+        return f;
+    }
+
+
+    // Returns a new promise which will be resolved with the object returned
+    // from `box(T&&)` when the future will be fulfilled, or rejected with a
+    // NSError when the future will be rejected. The error reason of an
+    // `objc_error` will be passed through. The future will be consumed.
+    template <typename T, typename F>
+    inline RXPromise* make_rxpromise(future<T>&& f, F&& box) {
+        RXPromise* promise = [[RXPromise alloc] init];
+        typename std::decay<F>::type b(std::forward<F>(box));
+        return detail::attach_rejection(promise, f.then([promise, b](T&& value) mutable {
+            [promise resolveWithResult:b(std::move(value))];
+        }));
+    }
+
+    inline RXPromise* make_rxpromise(future<id>&& f) {
+        return make_rxpromise(std::move(f), [](id value) { return value; });
+    }
+
+    // The promise will be fulfilled with nil.
+    inline RXPromise* make_rxpromise(future<void>&& f) {
+        RXPromise* promise = [[RXPromise alloc] init];
+        return detail::attach_rejection(promise, f.then([promise]() {
+            [promise fulfillWithValue:nil];
+        }));
+    }
+
+#endif // __OBJC__
+
+}
+
+#endif // __cplusplus
+
+#endif // RXPROMISE_RXFUTURE_H
@@ -18,7 +18,9 @@
 #import <Foundation/Foundation.h>
 #import "RXPromise.h"
 #import <dispatch/dispatch.h>
-#include <map>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
 #include "utility/DLog.h"
 
 
@@ -45,7 +47,8 @@ typedef enum RXPromise_StateT {
     Pending     = 0x0,
     Fulfilled   = 0x01,
     Rejected    = 0x02,
-    Cancelled   = 0x06
+    Cancelled   = 0x06,
+    Resolving   = 0x08  // transient: a resolver has claimed the promise, but the result is not yet published
 } RXPromise_State;
 
 
@@ -57,50 +60,119 @@ struct RXPromise_StateAndResult {
 
 @class RXPromise;
 
+
+// RXPROMISE_SYNC_QUEUE_SHARDS
+// The number of serial sync queues ("shards") which are used to synchronize
+// access to the promises' internal state. Each root promise will be assigned
+// to one shard based on its identity, and all promises which are created via
+// `then`, `thenOn`, etc. share the shard of their parent. That way, the ordering
+// guarantees within a chain are preserved while independent chains may be
+// processed in parallel.
+//
+// The default is 1, which means all promises share one sync queue.
+#if !defined (RXPROMISE_SYNC_QUEUE_SHARDS)
+#define RXPROMISE_SYNC_QUEUE_SHARDS 1
+#endif
+
+static_assert(RXPROMISE_SYNC_QUEUE_SHARDS > 0, "RXPROMISE_SYNC_QUEUE_SHARDS must be greater than zero");
+
+
+// RXPROMISE_INLINE_MAX_DEPTH
+// The maximum number of nested handlers registered with `thenInline` which
+// will be executed recursively on the same thread. Handlers beyond this depth
+// will be deferred and executed by the outermost inline handler on the same
+// thread, after it returned ("trampoline").
+#if !defined (RXPROMISE_INLINE_MAX_DEPTH)
+#define RXPROMISE_INLINE_MAX_DEPTH 32
+#endif
+
+static_assert(RXPROMISE_INLINE_MAX_DEPTH > 0, "RXPROMISE_INLINE_MAX_DEPTH must be greater than zero");
+
+
 namespace rxpromise {
     
     static_assert(OS_OBJECT_HAVE_OBJC_SUPPORT == 1, "");
     
     struct shared {
-        typedef std::multimap<void const*, __weak RXPromise*> assocs_t;
+        // A shard is a serial dispatch queue which serializes operations on
+        // the promises assigned to it.
+        struct shard {
+            dispatch_queue_t    sync_queue;
+        };
+        
+        static constexpr std::size_t shard_count = RXPROMISE_SYNC_QUEUE_SHARDS;
+        
+        shard shards[shard_count];
         
+        // The sync queue of the first shard. When sharding is not enabled, this
+        // is the one and only sync queue.
         dispatch_queue_t sync_queue;
         static constexpr char const* sync_queue_id = "RXPromise.shared_sync_queue";
         
         dispatch_queue_t default_concurrent_queue;
         static constexpr char const* default_concurrent_queue_id = "RXPromise.default_concurrent_queue";
         
+        // The queue specific value for key `QueueID` of a sync queue is a
+        // pointer to its shard.
         static constexpr char const* QueueID = "RXPromise.queue_id";
         
-        assocs_t  assocs;
         
         shared()
-        :   sync_queue(dispatch_queue_create(sync_queue_id, NULL)),
-        default_concurrent_queue(dispatch_queue_create(default_concurrent_queue_id, DISPATCH_QUEUE_CONCURRENT))
+        :   default_concurrent_queue(dispatch_queue_create(default_concurrent_queue_id, DISPATCH_QUEUE_CONCURRENT))
         {
-            assert(sync_queue);
+            for (std::size_t i = 0; i < shard_count; ++i) {
+                shards[i].sync_queue = dispatch_queue_create(sync_queue_id, NULL);
+                assert(shards[i].sync_queue);
+                dispatch_queue_set_specific(shards[i].sync_queue, QueueID, &shards[i], NULL);
+            }
+            sync_queue = shards[0].sync_queue;
             assert(default_concurrent_queue);
-            dispatch_queue_set_specific(sync_queue, QueueID, (void*)(sync_queue_id), NULL);
-            DLogInfo(@"created: sync_queue (0x%p), default_concurrent_queue (0y%p) ", (sync_queue), (default_concurrent_queue));
+            DLogInfo(@"created: sync_queue (0x%p) and %zu shard(s), default_concurrent_queue (0y%p) ", (sync_queue), shard_count, (default_concurrent_queue));
         }
         
         ~shared() {
             DLogInfo(@"destroyed: sync_queue (0x%p), default_concurrent_queue (0y%p) ", (sync_queue), (default_concurrent_queue));
-#if defined (DEBUG)
-            // Note: at exit, the sync queue *may* still have enqueued blocks,
-            // which insert/remove associations between a parent and its children
-            // running on a secondary thread. At exit, this running thread will be
-            // forced to terminate and the assocs container may not be clean. This
-            // is considered harmless.
-            if (assocs.size() != 0) {
-                DLogInfo(@"Association container not empty");
-            }
-#endif
+        }
+        
+        // Returns the shard for a root promise.
+        shard* shard_for(void const* promise) {
+            std::uintptr_t h = reinterpret_cast<std::uintptr_t>(promise) >> 4;
+            return &shards[h % shard_count];
+        }
+        
+        // Returns the shard whose sync queue is the current queue (or the target
+        // queue of the current queue), otherwise NULL.
+        static shard* current_shard() {
+            return static_cast<shard*>(dispatch_get_specific(QueueID));
+        }
+        
+        // Returns true if the current queue is the sync queue `queue`.
+        static bool is_synced(dispatch_queue_t queue) {
+            shard* s = current_shard();
+            return s != NULL && s->sync_queue == queue;
         }
         
     };
     
     
+    
+    
+    // Dispatches the block asynchronously to the execution context, which is a
+    // dispatch queue, a NSThread, a NSOperationQueue or a NSManagedObjectContext.
+    // If `executionContext` is nil, the block will be dispatched to the default
+    // concurrent queue.
+    void dispatch_to_execution_context(id executionContext, dispatch_block_t block);
+    
+    // The shared errors of the library's own cancellation and timeout reasons.
+    NSError* cancelled_error();
+    NSError* timeout_error();
+    
+    // Returns the reason if it is a NSError, otherwise a new NSError of the
+    // library's domain whose failure reason is the reason - with the code of a
+    // rejection (-1000) or of a cancellation (-1), respectively.
+    NSError* make_rejection_error(id reason);
+    NSError* make_cancellation_error(id reason);
+    
 }
 
 extern rxpromise::shared Shared;
@@ -110,4 +182,19 @@ extern rxpromise::shared Shared;
 - (RXPromise_StateAndResult) peakStateAndResult;
 - (RXPromise_StateAndResult) synced_peakStateAndResult;
 - (id) synced_peakResult;
+- (dispatch_queue_t) syncQueue;
+
+// Registers handlers which will be executed on the thread which resolves the
+// receiver, like `thenInline`, but without creating a returned promise. Meant
+// for internal handlers which are cheap and never block.
+- (void) rxp_registerInlineOnSuccess:(promise_completionHandler_t)onSuccess onFailure:(promise_errorHandler_t)onFailure;
+
+// Fulfills the receiver like `fulfillWithValue:`. Returns NO if the receiver has
+// already been resolved.
+- (BOOL) rxp_fulfillWithValue:(id)value;
+
+// Cancels the receiver if it is pending. Unlike `cancelWithReason:`, the
+// cancellation will not be forwarded to the children of a resolved receiver.
+// Returns NO if the receiver has already been resolved.
+- (BOOL) rxp_cancelIfPendingWithError:(NSError*)error;
 @end
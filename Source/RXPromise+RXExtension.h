@@ -27,8 +27,16 @@
 
  + (RXPromise*) all:(NSArray*)promises;
  + (RXPromise*) any:(NSArray*)promises;
+ + (RXPromise*) any:(NSArray*)promises cancelLosers:(BOOL)cancelLosers;
+ + (RXPromise*) race:(NSArray*)promises;
  + (RXPromise*) sequence:(NSArray*)inputs task:(RXPromise* (^)(id input)) task;
+ + (RXPromise*) map:(id)inputs concurrency:(NSUInteger)concurrency task:(rxp_unary_task)task;
+ + (RXPromise*) parallelMap:(NSArray*)inputs chunkSize:(NSUInteger)chunkSize block:(id(^)(id input, NSUInteger index))block;
  + (instancetype) repeat:(rxp_nullary_task)block;
+ + (RXPromise*) retry:(RXPromise*(^)(NSUInteger attempt))task
+          maxAttempts:(NSUInteger)maxAttempts
+              backoff:(NSTimeInterval)backoff
+          shouldRetry:(BOOL(^)(NSError* error, NSUInteger attempt))shouldRetry;
  
  @end
  
@@ -179,6 +187,47 @@ typedef RXPromise* (^rxp_nullary_task)();
 + (instancetype)any:(NSArray*)promises;
 
 
+/**
+ @brief Returns a new \c RXPromise object which behaves like the one returned from
+ \p any:, but optionally cancels the promises which lost.
+ 
+ @discussion If \p cancelLosers equals \c YES, as soon as the first promise in the
+ array has been fulfilled, the root promise of every other promise in the array
+ will be cancelled with reason \c \@"lost" - unless it is also the root of the
+ fulfilled promise. Cancelling the root cancels the underlying task and all
+ promises derived from it. This allows to issue redundant requests and to stop
+ the remaining ones once the first one succeeded.
+ 
+ @param promises A \c NSArray containing promises.
+ 
+ @param cancelLosers If \c YES, the roots of the other promises will be cancelled
+ once a promise has been fulfilled.
+ 
+ @return A new promise whose value is the value of the first fulfilled promise.
+ */
++ (instancetype)any:(NSArray*)promises cancelLosers:(BOOL)cancelLosers;
+
+
+/**
+ @brief Returns a new \c RXPromise object which will be resolved with the result of
+ the first promise in the given array which has been resolved.
+ 
+ @discussion If the first resolved promise has been fulfilled, the returned promise
+ will be fulfilled with its value. Otherwise, the returned promise will be rejected
+ with its error reason - also if the first resolved promise has been cancelled.
+ The results of the subsequent promises will be ignored, and the other promises
+ remain unaffected.
+ 
+ @param promises A \c NSArray containing promises.
+ 
+ @note The returned promise will be rejected with reason \c \@"parameter error" if
+ the parameter \p promises is \c nil or empty.
+ 
+ @return A new promise whose result is the result of the first resolved promise.
+ */
++ (instancetype)race:(NSArray*)promises;
+
+
 /**
  For each element in array \p inputs sequentially call the asynchronous task
  passing it the element as its input argument.
@@ -203,6 +252,61 @@ typedef RXPromise* (^rxp_nullary_task)();
 + (instancetype) sequence:(NSArray*)inputs task:(RXPromise* (^)(id input)) task;
 
 
+/**
+ For each element of \p inputs call the asynchronous task passing it the element
+ as its input argument, with at most \p concurrency tasks running at the same time.
+
+ @discussion The inputs will be taken from \p inputs only when a task can be
+ started, so at most \p concurrency task promises are pending at any time. This
+ allows to process large or lazily generated inputs. The tasks will be started
+ in the order of the inputs on a private serial queue.
+ 
+ If all tasks succeed, the returned promise will be fulfilled with an array
+ containing the result of each task in the order of the inputs. A \c nil result,
+ or a task returning \c nil instead of a promise, yields \c NSNull.
+ 
+ If a task fails, the returned promise will be rejected with its error reason.
+ If the returned promise will be rejected or cancelled, no further tasks will be
+ started and the root promises of the running tasks will be cancelled.
+
+ @param inputs A \c NSArray or \c NSEnumerator of input values. It may be \c nil.
+
+ @param concurrency The maximum number of running tasks. Must be greater than zero.
+
+ @param task The unary task to be invoked.
+
+ @return A promise.
+ */
++ (instancetype) map:(id)inputs concurrency:(NSUInteger)concurrency task:(rxp_unary_task)task;
+
+
+/**
+ Maps each element of \p inputs with the synchronous \p block in parallel, and
+ returns a promise which will be fulfilled with the mapped array.
+
+ @discussion The inputs will be processed in chunks by at most one worker per
+ active processor on the default concurrent queue. A worker takes a chunk of
+ at least \p chunkSize inputs at a time; while many inputs are remaining, it
+ takes larger chunks. No thread waits for the workers to finish.
+ 
+ If \p block returns \c nil, the mapped array will contain \c NSNull. If
+ \p block returns a \c NSError, the returned promise will be rejected with it.
+ If the returned promise will be cancelled, the workers stop before their next
+ chunk.
+
+ @param inputs The array of input values. It may be \c nil or empty, in which case
+ the returned promise will be fulfilled with an empty array.
+
+ @param chunkSize The minimum number of inputs a worker processes at a time. If zero,
+ one is assumed. Choose a larger value if \p block is very cheap.
+
+ @param block The block which maps an element. It will be invoked concurrently.
+
+ @return A promise.
+ */
++ (instancetype) parallelMap:(NSArray*)inputs chunkSize:(NSUInteger)chunkSize block:(id(^)(id input, NSUInteger index))block;
+
+
 /**
  Executes the asynchronous block repeatedly until the block returns \c nil or the 
  promise returned from the current block will be rejected.
@@ -225,6 +329,42 @@ typedef RXPromise* (^rxp_nullary_task)();
 + (instancetype) repeat:(rxp_nullary_task)block;
 
 
+/**
+ Invokes the asynchronous task and invokes it again when its promise will be
+ rejected, until it succeeds or the maximum number of attempts has been reached.
+
+ @discussion Before each further attempt the method waits for a backoff delay,
+ which doubles with each attempt: the delay after attempt \c n is
+ <tt>backoff * 2^(n-1)</tt>, reduced by a random fraction of up to one half, so
+ that clients which failed at the same time spread their retries. The exponent
+ is limited to 16. The delays are managed by the shared timer of \p setTimeout:.
+
+ If the returned promise will be cancelled, no further attempt will be made, and
+ the root promise of the pending attempt will be cancelled.
+
+ @param task The block which starts an attempt. Its parameter is the number of
+ the attempt, starting with 1. The first attempt will be started synchronously,
+ further attempts will be started on the default concurrent queue. If it returns
+ \c nil, the returned promise will be fulfilled with \c nil.
+
+ @param maxAttempts The maximum number of attempts. If zero, one is assumed.
+
+ @param backoff The delay in seconds before the second attempt.
+
+ @param shouldRetry An optional block which will be invoked with the error reason
+ of a failed attempt and the number of the attempt. If it returns \c NO, the
+ returned promise will be rejected with the error without further attempts. If
+ \c nil, every error will be retried.
+
+ @return A new promise which will be fulfilled with the result of the first
+ successful attempt, or rejected with the error reason of the last attempt.
+ */
++ (instancetype) retry:(RXPromise*(^)(NSUInteger attempt))task
+           maxAttempts:(NSUInteger)maxAttempts
+               backoff:(NSTimeInterval)backoff
+           shouldRetry:(BOOL(^)(NSError* error, NSUInteger attempt))shouldRetry;
+
+
 
 #pragma mark - iOS Specific
 
@@ -22,7 +22,14 @@
 #if defined(TARGET_OS_IOS) && TARGET_OS_IOS
     #import <UIKit/UIKit.h>
 #endif
+#include "utility/timer_service.h"
 #include <cassert>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <vector>
 
 // Set default logger severity to "Error" (logs only errors)
 #if !defined (DEBUG_LOG)
@@ -43,17 +50,375 @@
 
 namespace {
     
-    void sync_sequence(NSEnumerator* iter, __weak RXPromise* weakReturnedPromise,
+    // The state shared by the handlers of `all:` and `allSettled:`.
+    //
+    // Each handler stores the result of its input into its own slot and then
+    // counts down. The handler which counts down to zero collects the results.
+    // Once the fan-in has been aborted, the results stored so far will be
+    // released immediately, and the results of the remaining inputs will be
+    // discarded.
+    class fan_in {
+    public:
+        explicit fan_in(NSUInteger count)
+        :   slots_(new std::atomic<void*>[count]), count_(count), remaining_(count), aborted_(false)
+        {
+            for (NSUInteger i = 0; i < count_; ++i) {
+                slots_[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+        
+        ~fan_in() {
+            for (NSUInteger i = 0; i < count_; ++i) {
+                release(i);
+            }
+        }
+        
+        fan_in(fan_in const&) = delete;
+        fan_in& operator=(fan_in const&) = delete;
+        
+        // Stores the result of the input at `index`. Returns true if this has
+        // been the last input.
+        bool set(NSUInteger index, id result) {
+            if (!aborted_.load()) {
+                slots_[index].store((__bridge_retained void*)(result ? result : [NSNull null]));
+                if (aborted_.load()) {
+                    release(index);
+                }
+            }
+            return remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        }
+        
+        // Releases the results stored so far. Returns false if the fan-in has
+        // already been aborted.
+        bool abort() {
+            if (aborted_.exchange(true)) {
+                return false;
+            }
+            for (NSUInteger i = 0; i < count_; ++i) {
+                release(i);
+            }
+            return true;
+        }
+        
+        // Returns the results in the order of the inputs, or nil if the fan-in
+        // has been aborted. Requires that all results have been set.
+        NSArray* collect() {
+            std::vector<id> results;
+            results.reserve(count_);
+            for (NSUInteger i = 0; i < count_; ++i) {
+                id result = (__bridge_transfer id)slots_[i].exchange(nullptr);
+                if (result == nil) {
+                    return nil;
+                }
+                results.push_back(result);
+            }
+            return [[NSArray alloc] initWithObjects:results.data() count:count_];
+        }
+        
+    private:
+        void release(NSUInteger index) {
+            if (void* p = slots_[index].exchange(nullptr)) {
+                id result = (__bridge_transfer id)p;
+                (void)result;
+            }
+        }
+        
+        std::unique_ptr<std::atomic<void*>[]> slots_;   // retained results
+        NSUInteger                  count_;
+        std::atomic<NSUInteger>     remaining_;
+        std::atomic<bool>           aborted_;
+    };
+    
+    
+    // The state shared by the handlers of `any:` and `race:`.
+    class contest {
+    public:
+        // If `keepInputs` is true, the contest keeps weak references to the
+        // promises in order to cancel the losers.
+        contest(NSArray* promises, bool keepInputs)
+        :   remaining_([promises count]), settled_(false)
+        {
+            if (keepInputs) {
+                inputs_.reserve([promises count]);
+                for (RXPromise* p in promises) {
+                    inputs_.push_back(p);
+                }
+            }
+        }
+        
+        contest(contest const&) = delete;
+        contest& operator=(contest const&) = delete;
+        
+        // Returns true for exactly one caller, the winner.
+        bool win() {
+            return !settled_.exchange(true);
+        }
+        
+        // Counts down the inputs which did not win. Returns true if this has
+        // been the last input.
+        bool lose() {
+            return remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        }
+        
+        // Cancels the roots of all inputs which do not share their root with
+        // the winner.
+        void cancel_losers(RXPromise* winner, id reason) {
+            RXPromise* winnerRoot = winner.root;
+            for (auto const& input : inputs_) {
+                RXPromise* p = input;
+                if (p == nil || p == winner) {
+                    continue;
+                }
+                RXPromise* root = p.root;
+                if (root != winnerRoot) {
+                    [root cancelWithReason:reason];
+                }
+            }
+            inputs_.clear();
+        }
+        
+    private:
+        std::atomic<NSUInteger>         remaining_;
+        std::atomic<bool>               settled_;
+        std::vector<__weak RXPromise*>  inputs_;
+    };
+    
+    
+    // The state of `map:concurrency:task:`. It will only be accessed on its
+    // private serial queue, on which the tasks will be started, too.
+    struct map_state {
+        dispatch_queue_t    queue;
+        NSEnumerator*       inputs;
+        rxp_unary_task      task;
+        NSUInteger          concurrency;
+        NSMutableArray*     results;
+        NSMutableSet*       running;    // the task promises in flight
+        bool                exhausted;
+        __weak RXPromise*   returnedPromise;
+    };
+    
+    // Starts tasks until `concurrency` tasks are in flight or the inputs have
+    // been exhausted, and fulfills the returned promise when all tasks have
+    // been finished.
+    void map_pump(std::shared_ptr<map_state> const& state) {
+        RXPromise* returnedPromise = state->returnedPromise;
+        if (returnedPromise == nil || !returnedPromise.isPending) {
+            return;
+        }
+        while ([state->running count] < state->concurrency && !state->exhausted) {
+            id input = [state->inputs nextObject];
+            if (input == nil) {
+                state->exhausted = true;
+                state->inputs = nil;
+                break;
+            }
+            NSUInteger index = [state->results count];
+            [state->results addObject:[NSNull null]];
+            RXPromise* taskPromise = state->task(input);
+            if (taskPromise == nil) {
+                continue;
+            }
+            [state->running addObject:taskPromise];
+            std::shared_ptr<map_state> s = state;
+            __weak RXPromise* weakTaskPromise = taskPromise;
+            [taskPromise rxp_registerInlineOnSuccess:^id(id result) {
+                dispatch_async(s->queue, ^{
+                    if (result) {
+                        s->results[index] = result;
+                    }
+                    [s->running removeObject:weakTaskPromise];
+                    map_pump(s);
+                });
+                return nil;
+            } onFailure:^id(NSError* error) {
+                dispatch_async(s->queue, ^{
+                    [s->running removeObject:weakTaskPromise];
+                    [s->returnedPromise rejectWithReason:error];
+                });
+                return nil;
+            }];
+        }
+        if (state->exhausted && [state->running count] == 0) {
+            [returnedPromise fulfillWithValue:[state->results copy]];
+        }
+    }
+    
+    
+    // The state of `parallelMap:chunkSize:block:`, shared by its workers.
+    struct parallel_map_state {
+        NSArray*                    inputs;
+        id (^block)(id, NSUInteger);
+        std::vector<id>             results;        // each slot is written by exactly one worker
+        NSUInteger                  chunkSize;      // the minimum chunk size
+        NSUInteger                  workerCount;
+        std::atomic<NSUInteger>     next;           // the index of the first input not yet taken
+        std::atomic<NSUInteger>     activeWorkers;
+        RXPromise*                  returnedPromise;
+    };
+    
+    // Takes chunks of inputs until all inputs have been taken or the returned
+    // promise has been resolved. The chunk size decreases with the number of
+    // remaining inputs, so that the workers finish at about the same time. The
+    // last worker which finishes fulfills the returned promise.
+    void parallel_map_worker(std::shared_ptr<parallel_map_state> const& state) {
+        NSUInteger const count = state->results.size();
+        for (;;) {
+            RXPromise* returnedPromise = state->returnedPromise;
+            if (!returnedPromise.isPending) {
+                break;
+            }
+            NSUInteger begin = state->next.load(std::memory_order_relaxed);
+            NSUInteger end = count;
+            do {
+                if (begin >= count) {
+                    break;
+                }
+                NSUInteger size = (count - begin) / (4 * state->workerCount);
+                end = begin + (size > state->chunkSize ? size : state->chunkSize);
+                if (end > count) {
+                    end = count;
+                }
+            } while (!state->next.compare_exchange_weak(begin, end, std::memory_order_relaxed));
+            if (begin >= count) {
+                break;
+            }
+            @autoreleasepool {
+                for (NSUInteger i = begin; i < end; ++i) {
+                    id result = state->block(state->inputs[i], i);
+                    if ([result isKindOfClass:[NSError class]]) {
+                        [returnedPromise rejectWithReason:result];
+                        break;
+                    }
+                    state->results[i] = result ? result : [NSNull null];
+                }
+            }
+        }
+        if (state->activeWorkers.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if (state->returnedPromise.isPending) {
+                [state->returnedPromise fulfillWithValue:[[NSArray alloc] initWithObjects:state->results.data() count:count]];
+            }
+        }
+    }
+    
+    
+    // The state of `retry:maxAttempts:backoff:shouldRetry:`. The handlers of
+    // an attempt, the backoff timer and the handler of the returned promise
+    // may execute concurrently, thus the mutable members are protected by
+    // `mutex`.
+    struct retry_state {
+        std::mutex                          mutex;
+        RXPromise* (^task)(NSUInteger attempt);
+        BOOL (^shouldRetry)(NSError* error, NSUInteger attempt);
+        NSUInteger                          maxAttempts;
+        NSTimeInterval                      backoff;
+        RXPromise*                          returnedPromise;
+        std::minstd_rand                    random;
+        NSUInteger                          attempt;    // the number of attempts started
+        RXPromise*                          current;    // the pending attempt
+        rxpromise::timer_service::timer*    timer;      // the pending backoff timer
+        bool                                stopped;    // the returned promise has been resolved
+    };
+    
+    void retry_attempt(std::shared_ptr<retry_state> const& state);
+    
+    // Requires the lock. Returns the delay before the next attempt in
+    // nanoseconds: the backoff doubles with each attempt, and a random
+    // duration of up to half of it will be subtracted, so that clients which
+    // failed at the same time do not retry at the same time.
+    uint64_t retry_delay(retry_state& state) {
+        NSUInteger exponent = state.attempt - 1 < 16 ? state.attempt - 1 : 16;
+        double delay = state.backoff * NSEC_PER_SEC * (double)(1u << exponent);
+        double jitter = std::uniform_real_distribution<double>(0.0, 0.5)(state.random);
+        return (uint64_t)(delay * (1.0 - jitter));
+    }
+    
+    void retry_failed(std::shared_ptr<retry_state> const& state, NSError* error) {
+        NSUInteger attempt;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->current = nil;
+            if (state->stopped) {
+                return;
+            }
+            attempt = state->attempt;
+        }
+        if (attempt >= state->maxAttempts || (state->shouldRetry && !state->shouldRetry(error, attempt))) {
+            [state->returnedPromise rejectWithReason:error];
+            return;
+        }
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->stopped) {
+            return;
+        }
+        // The timer will be stored before its block can take the lock:
+        std::shared_ptr<retry_state> s = state;
+        state->timer = rxpromise::timer_service::shared().schedule(retry_delay(*state), ^{
+            rxpromise::timer_service::timer* timer;
+            {
+                std::lock_guard<std::mutex> lock(s->mutex);
+                timer = s->timer;
+                s->timer = nullptr;
+            }
+            if (timer) {
+                rxpromise::timer_service::shared().cancel(timer);
+                // Timer blocks must not take long, start the attempt elsewhere:
+                rxpromise::dispatch_to_execution_context(nil, ^{
+                    retry_attempt(s);
+                });
+            }
+        });
+    }
+    
+    void retry_attempt(std::shared_ptr<retry_state> const& state) {
+        NSUInteger attempt;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->stopped) {
+                return;
+            }
+            attempt = ++state->attempt;
+        }
+        RXPromise* taskPromise = state->task(attempt);
+        if (taskPromise == nil) {
+            [state->returnedPromise fulfillWithValue:nil];
+            return;
+        }
+        bool stopped;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            stopped = state->stopped;
+            if (!stopped) {
+                state->current = taskPromise;
+            }
+        }
+        if (stopped) {
+            // The returned promise has been resolved while the task has been started:
+            [taskPromise.root cancel];
+            return;
+        }
+        std::shared_ptr<retry_state> s = state;
+        [taskPromise rxp_registerInlineOnSuccess:^id(id result) {
+            [s->returnedPromise fulfillWithValue:result];
+            return nil;
+        } onFailure:^id(NSError* error) {
+            retry_failed(s, error);
+            return nil;
+        }];
+    }
+    
+    
+    void sync_sequence(dispatch_queue_t sync_queue, NSEnumerator* iter, __weak RXPromise* weakReturnedPromise,
                        RXPromiseWrapper* taskPromise, rxp_unary_task task)
     {
         // Implementation notes:
         // We have a shared resource `root` which will be multiple times set by this
         // method and which is retrieved in the error handler of the returned promise
         // which is registered only once.
+        // `sync_queue` is the sync queue of the returned promise.
         
-        assert(Shared.sync_queue);
+        assert(sync_queue);
         assert(task);
-        assert(dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id);
+        assert(rxpromise::shared::is_synced(sync_queue));
         
         RXPromise* returnedPromise = weakReturnedPromise;
         
@@ -72,8 +437,8 @@ namespace {
         taskPromise.promise = task(obj);
         
         // Register a continuation for the next object:
-        taskPromise.promise.thenOn(Shared.sync_queue, ^id(id result){
-            sync_sequence(iter, returnedPromise, taskPromise, task);
+        taskPromise.promise.thenOn(sync_queue, ^id(id result){
+            sync_sequence(sync_queue, iter, returnedPromise, taskPromise, task);
             return returnedPromise;
         }, ^id(NSError*error){
             return error;
@@ -114,85 +479,136 @@ namespace {
 
 +(instancetype) all:(NSArray*)promises
 {
-    __block NSUInteger count = [promises count];
+    NSUInteger count = [promises count];
     if (count == 0) {
         return [RXPromise promiseWithResult:@[]];
     }
     RXPromise* promise = [[self alloc] init];
     __weak RXPromise* weakPromise = promise;
-    promise_completionHandler_t onSuccess = ^id(id result) {
-        --count;
-        RXPromise* strongPromise = weakPromise;
-        if (count == 0 and strongPromise) {
-            NSMutableArray* results = [[NSMutableArray alloc] initWithCapacity:[promises count]];
-            for (RXPromise* p in promises) {
-                id result = [p synced_peakResult];
-                [results addObject:result ? result : [NSNull null]];
-            }
-            [strongPromise fulfillWithValue:results];
-        }
-        return nil;
-    };
+    // The handlers execute on the thread which resolves the input, and only
+    // store the result. A rejection or the cancellation of the returned
+    // promise releases the results collected so far:
+    std::shared_ptr<fan_in> state = std::make_shared<fan_in>(count);
     promise_errorHandler_t onError = ^id(NSError* error) {
+        state->abort();
         [weakPromise rejectWithReason:error];
         return nil;
     };
+    NSUInteger index = 0;
     for (RXPromise* p in promises) {
-        p.thenOn(Shared.sync_queue, onSuccess, onError);
+        [p rxp_registerInlineOnSuccess:^id(id result) {
+            if (state->set(index, result)) {
+                NSArray* results = state->collect();
+                if (results) {
+                    [weakPromise fulfillWithValue:results];
+                }
+            }
+            return nil;
+        } onFailure:onError];
+        ++index;
     }
+    [promise rxp_registerInlineOnSuccess:nil onFailure:^id(NSError* error) {
+        state->abort();
+        return nil;
+    }];
     return promise;
 }
 
 +(instancetype) allSettled:(NSArray*)promises
 {
-    __block NSUInteger count = [promises count];
+    NSUInteger count = [promises count];
     if (count == 0) {
         return [RXPromise promiseWithResult:@[]];
     }
     RXPromise* promise = [[self alloc] init];
     __weak RXPromise* weakPromise = promise;
-    promise_completionHandler_t onSuccess = ^id(id result) {
-        --count;
-        RXPromise* strongPromise = weakPromise;
-        if (count == 0 and strongPromise) {
-            NSMutableArray* results = [[NSMutableArray alloc] initWithCapacity:[promises count]];
-            for (RXPromise* p in promises) {
-                RXSettledResult *result = [[RXSettledResult alloc] initWithFulfilled:p.isFulfilled andResult:[p synced_peakResult]];
-                [results addObject:result];
+    // See `all:`
+    std::shared_ptr<fan_in> state = std::make_shared<fan_in>(count);
+    void (^settle)(NSUInteger, BOOL, id) = ^(NSUInteger index, BOOL fulfilled, id result) {
+        if (state->set(index, [[RXSettledResult alloc] initWithFulfilled:fulfilled andResult:result])) {
+            NSArray* results = state->collect();
+            if (results) {
+                [weakPromise fulfillWithValue:results];
             }
-            [strongPromise fulfillWithValue:results];
         }
-        return nil;
     };
+    NSUInteger index = 0;
     for (RXPromise* p in promises) {
-        p.thenOn(Shared.sync_queue, onSuccess, onSuccess);
+        [p rxp_registerInlineOnSuccess:^id(id result) {
+            settle(index, YES, result);
+            return nil;
+        } onFailure:^id(NSError* error) {
+            settle(index, NO, error);
+            return nil;
+        }];
+        ++index;
     }
+    [promise rxp_registerInlineOnSuccess:nil onFailure:^id(NSError* error) {
+        state->abort();
+        return nil;
+    }];
     return promise;
 }
 
 
 + (instancetype) any:(NSArray*)promises
+{
+    return [self any:promises cancelLosers:NO];
+}
+
+
++ (instancetype) any:(NSArray*)promises cancelLosers:(BOOL)cancelLosers
 {
     RXPromise* promise = [[self alloc] init];
-    __block NSUInteger count = [promises count];
+    NSUInteger count = [promises count];
     if (count == 0) {
         [promise rejectWithReason:@"parameter error"];
         return promise;
     }
     __weak RXPromise* weakPromise = promise;
-    promise_completionHandler_t onSuccess = ^(id result){
-        [weakPromise fulfillWithValue:result];
-        return result;
-    };
-    promise_errorHandler_t onError = ^(NSError* error) {
-        --count;
-        if (count == 0) {
-            [weakPromise rejectWithReason:@"none succeeded"];
-        }
-        return error;
-    };
+    std::shared_ptr<contest> state = std::make_shared<contest>(promises, cancelLosers);
+    for (RXPromise* p in promises) {
+        __weak RXPromise* weakInput = p;
+        [p rxp_registerInlineOnSuccess:^id(id result) {
+            if (state->win()) {
+                [weakPromise fulfillWithValue:result];
+                if (cancelLosers) {
+                    state->cancel_losers(weakInput, @"lost");
+                }
+            }
+            return nil;
+        } onFailure:^id(NSError* error) {
+            if (state->lose()) {
+                [weakPromise rejectWithReason:@"none succeeded"];
+            }
+            return nil;
+        }];
+    }
+    return promise;
+}
+
+
++ (instancetype) race:(NSArray*)promises
+{
+    RXPromise* promise = [[self alloc] init];
+    if ([promises count] == 0) {
+        [promise rejectWithReason:@"parameter error"];
+        return promise;
+    }
+    __weak RXPromise* weakPromise = promise;
+    std::shared_ptr<contest> state = std::make_shared<contest>(promises, false);
     for (RXPromise* p in promises) {
-        p.thenOn(Shared.sync_queue, onSuccess, onError);
+        [p rxp_registerInlineOnSuccess:^id(id result) {
+            if (state->win()) {
+                [weakPromise fulfillWithValue:result];
+            }
+            return nil;
+        } onFailure:^id(NSError* error) {
+            if (state->win()) {
+                [weakPromise rejectWithReason:error];
+            }
+            return nil;
+        }];
     }
     return promise;
 }
@@ -209,7 +625,7 @@ namespace {
 + (instancetype) sequence:(NSArray*)inputs task:(rxp_unary_task)task
 {
     NSParameterAssert(task);
-    assert(dispatch_get_specific(rxpromise::shared::QueueID) != rxpromise::shared::sync_queue_id);
+    assert(rxpromise::shared::current_shard() == NULL);
     NSEnumerator* iter = [inputs objectEnumerator];
     
     // A promise wrapper holding the current task promise:
@@ -217,20 +633,134 @@ namespace {
     
     // Create the returned promise:
     RXPromise* returnedPromise = [[self alloc] init];
+    dispatch_queue_t sync_queue = [returnedPromise syncQueue];
     // Register an error handler which cancels the current task's root:
-    returnedPromise.thenOn(Shared.sync_queue, nil, ^id(NSError*error){
+    returnedPromise.thenOn(sync_queue, nil, ^id(NSError*error){
         DLogInfo(@"cancelling task promise's root: %@", currentTaskPromise.promise.root);
         [currentTaskPromise.promise.root cancelWithReason:error];
         return error;
     });
     
-    dispatch_sync(Shared.sync_queue, ^{
-        sync_sequence(iter, returnedPromise, currentTaskPromise, task);
+    dispatch_sync(sync_queue, ^{
+        sync_sequence(sync_queue, iter, returnedPromise, currentTaskPromise, task);
+    });
+    return returnedPromise;
+}
+
+
++ (instancetype) map:(id)inputs concurrency:(NSUInteger)concurrency task:(rxp_unary_task)task
+{
+    NSParameterAssert(task);
+    NSParameterAssert(concurrency > 0);
+    NSParameterAssert(inputs == nil || [inputs isKindOfClass:[NSArray class]] || [inputs isKindOfClass:[NSEnumerator class]]);
+    RXPromise* returnedPromise = [[self alloc] init];
+    std::shared_ptr<map_state> state = std::make_shared<map_state>();
+    // The tasks will not be started on a sync queue, since client code must
+    // not execute there:
+    state->queue = dispatch_queue_create("RXPromise.map_queue", NULL);
+    state->inputs = [inputs isKindOfClass:[NSArray class]] ? [inputs objectEnumerator] : inputs;
+    state->task = task;
+    state->concurrency = concurrency > 0 ? concurrency : 1;
+    state->results = [[NSMutableArray alloc] init];
+    state->running = [[NSMutableSet alloc] initWithCapacity:state->concurrency];
+    state->exhausted = inputs == nil;
+    state->returnedPromise = returnedPromise;
+    // If the returned promise will be rejected or cancelled, cancel the roots
+    // of the tasks in flight and stop starting new ones:
+    [returnedPromise rxp_registerInlineOnSuccess:nil onFailure:^id(NSError* error) {
+        dispatch_async(state->queue, ^{
+            NSArray* running = [state->running allObjects];
+            [state->running removeAllObjects];
+            state->exhausted = true;
+            state->inputs = nil;
+            for (RXPromise* p in running) {
+                [p.root cancelWithReason:error];
+            }
+        });
+        return nil;
+    }];
+    dispatch_async(state->queue, ^{
+        map_pump(state);
     });
     return returnedPromise;
 }
 
 
++ (instancetype) parallelMap:(NSArray*)inputs chunkSize:(NSUInteger)chunkSize block:(id(^)(id input, NSUInteger index))block
+{
+    NSParameterAssert(block);
+    NSUInteger count = [inputs count];
+    if (count == 0) {
+        return [self promiseWithResult:@[]];
+    }
+    RXPromise* returnedPromise = [[self alloc] init];
+    std::shared_ptr<parallel_map_state> state = std::make_shared<parallel_map_state>();
+    state->inputs = [inputs copy];
+    state->block = block;
+    state->results.resize(count);
+    state->chunkSize = chunkSize > 0 ? chunkSize : 1;
+    NSUInteger chunks = (count + state->chunkSize - 1) / state->chunkSize;
+    NSUInteger processors = [[NSProcessInfo processInfo] activeProcessorCount];
+    state->workerCount = chunks < processors ? chunks : processors;
+    state->next.store(0, std::memory_order_relaxed);
+    state->activeWorkers.store(state->workerCount, std::memory_order_relaxed);
+    state->returnedPromise = returnedPromise;
+    for (NSUInteger i = 0; i < state->workerCount; ++i) {
+        dispatch_async(Shared.default_concurrent_queue, ^{
+            parallel_map_worker(state);
+        });
+    }
+    return returnedPromise;
+}
+
+
++ (instancetype) retry:(RXPromise*(^)(NSUInteger attempt))task
+            maxAttempts:(NSUInteger)maxAttempts
+                backoff:(NSTimeInterval)backoff
+            shouldRetry:(BOOL(^)(NSError* error, NSUInteger attempt))shouldRetry
+{
+    NSParameterAssert(task);
+    RXPromise* returnedPromise = [[self alloc] init];
+    std::shared_ptr<retry_state> state = std::make_shared<retry_state>();
+    state->task = task;
+    state->shouldRetry = shouldRetry;
+    state->maxAttempts = maxAttempts > 0 ? maxAttempts : 1;
+    state->backoff = backoff > 0 ? backoff : 0;
+    state->returnedPromise = returnedPromise;
+    state->random.seed((std::minstd_rand::result_type)(std::chrono::steady_clock::now().time_since_epoch().count()
+                                                       ^ reinterpret_cast<std::uintptr_t>(state.get())));
+    state->attempt = 0;
+    state->timer = nullptr;
+    state->stopped = false;
+    // Once the returned promise has been resolved - in particular when it has
+    // been cancelled - no further attempt will be started, the backoff timer
+    // will be cancelled and the root of the pending attempt will be cancelled:
+    [returnedPromise rxp_registerInlineOnSuccess:^id(id result) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->stopped = true;
+        return nil;
+    } onFailure:^id(NSError* error) {
+        RXPromise* current;
+        rxpromise::timer_service::timer* timer;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->stopped = true;
+            current = state->current;
+            state->current = nil;
+            timer = state->timer;
+            state->timer = nullptr;
+        }
+        if (timer) {
+            rxpromise::timer_service::shared().cancel(timer);
+        }
+        [current.root cancelWithReason:error];
+        return nil;
+    }];
+    retry_attempt(state);
+    return returnedPromise;
+}
+
+
 + (instancetype) repeat: (rxp_nullary_task)block {
     RXPromise* promise = [[self alloc] init];
     rxp_while(promise, block);
@@ -0,0 +1,59 @@
+//
+//  RXPromise+RXPooling.h
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#import "RXPromise.h"
+
+/* Synopsis
+ 
+ @interface RXPromise (RXPooling)
+ 
+ + (BOOL) poolingEnabled;
+ + (void) setPoolingEnabled:(BOOL)enabled;
+ 
+ @end
+ 
+*/
+
+
+@interface RXPromise (RXPooling)
+
+/**
+ @brief Returns \c YES if internal records are allocated from per thread pools.
+ 
+ @discussion Pooling is disabled by default.
+ */
++ (BOOL) poolingEnabled;
+
+
+/**
+ @brief Enables or disables pooling at runtime.
+ 
+ @discussion When enabled, the continuations of promises, the links to their
+ children and the records of timeouts will be allocated from per thread free
+ lists, which avoids calls of the general purpose allocator in code which
+ creates many short-lived promises. Each thread caches a limited number of
+ records, which will be released when the thread exits.
+ 
+ @par Promise objects and handler blocks are not pooled; they are allocated by
+ the Objective-C runtime.
+ 
+ @par Has no effect if the library has been compiled with \c RXPROMISE_POOLING
+ defined as \c 0.
+ */
++ (void) setPoolingEnabled:(BOOL)enabled;
+
+@end
@@ -0,0 +1,43 @@
+//
+//  RXPromise+RXPooling.mm
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+
+#if (!__has_feature(objc_arc))
+#error this file requires arc enabled
+#endif
+
+#import "RXPromise+RXPooling.h"
+#import "RXPromise.h"
+#include "utility/pool.h"
+
+
+@implementation RXPromise (RXPooling)
+
++ (BOOL) poolingEnabled {
+#if RXPROMISE_POOLING
+    return rxpromise::pooling<>::enabled.load(std::memory_order_relaxed) ? YES : NO;
+#else
+    return NO;
+#endif
+}
+
+
++ (void) setPoolingEnabled:(BOOL)enabled {
+    rxpromise::pooling<>::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+@end
@@ -0,0 +1,104 @@
+//
+//  RXPromise+RXStatistics.h
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#import "RXPromise.h"
+
+/* Synopsis
+ 
+ @interface RXPromise (RXStatistics)
+ 
+ + (NSDictionary*) statistics;
+ + (void) resetStatistics;
+ + (BOOL) statisticsEnabled;
+ + (void) setStatisticsEnabled:(BOOL)enabled;
+ 
+ @end
+ 
+*/
+
+
+@interface RXPromise (RXStatistics)
+
+/**
+ @brief Returns a snapshot of the runtime statistics of all promises.
+ 
+ @discussion The returned dictionary contains the following keys:
+ 
+ - \c @"created", \c @"fulfilled", \c @"rejected", \c @"cancelled",
+   \c @"deallocated": the number of promises which have been created, resolved
+   or deallocated (\c NSNumber).
+ 
+ - \c @"pending": the number of promises which have been created but not been
+   resolved, including promises which have been deallocated while pending.
+ 
+ - \c @"dispatched": a dictionary with the number of handlers which have been
+   dispatched per kind of execution context: \c @"concurrent" (\p then),
+   \c @"inline" (\p thenInline), \c @"queue" (a dispatch queue) and \c @"other"
+   (a \c NSThread, \c NSOperationQueue or \c NSManagedObjectContext).
+ 
+ - \c @"handlerLatency": a histogram of the time from resolving a promise - or
+   registering a handler on a promise which is already resolved - until the
+   handler starts executing.
+ 
+ - \c @"syncQueueWait": a histogram of the time internal operations wait for
+   the sync queue.
+ 
+ A histogram is a dictionary with the keys \c @"count", \c @"p50", \c @"p99"
+ and \c @"max", whose values are in nanoseconds, and \c @"buckets". The latter
+ is an array of counts where the element at index \c i counts the durations
+ in the range [2^(i-1), 2^i) nanoseconds. The percentiles and the maximum are
+ the upper bounds of the corresponding buckets. Histograms are sampled: they
+ record one of \c RXPROMISE_STATISTICS_SAMPLE_PERIOD (default 64) events per
+ thread stripe, while the counters count every event.
+ 
+ @par The counters are updated with relaxed atomic operations and are not read
+ atomically as a whole. While promises are being processed, the counters may be
+ slightly inconsistent with each other.
+ 
+ @return A dictionary, or \c nil if the library has been compiled with
+ \c RXPROMISE_STATISTICS defined as \c 0.
+ */
++ (NSDictionary*) statistics;
+
+
+/**
+ @brief Sets all counters and histograms to zero.
+ */
++ (void) resetStatistics;
+
+
+/**
+ @brief Returns \c YES if the statistics are being collected.
+ 
+ @discussion Collecting is enabled by default, unless the library has been compiled
+ with \c RXPROMISE_STATISTICS defined as \c 0. Counters are striped per thread
+ and latencies are sampled, so collecting is meant to be left enabled in
+ production.
+ */
++ (BOOL) statisticsEnabled;
+
+
+/**
+ @brief Enables or disables collecting the statistics at runtime.
+ 
+ @discussion When disabled, the cost of collecting is one load and one branch
+ per probe. Has no effect if the library has been compiled with
+ \c RXPROMISE_STATISTICS defined as \c 0.
+ */
++ (void) setStatisticsEnabled:(BOOL)enabled;
+
+@end
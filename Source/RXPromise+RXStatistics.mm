@@ -0,0 +1,121 @@
+//
+//  RXPromise+RXStatistics.mm
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+
+#if (!__has_feature(objc_arc))
+#error this file requires arc enabled
+#endif
+
+#import "RXPromise+RXStatistics.h"
+#import "RXPromise.h"
+#include "utility/statistics.h"
+
+
+namespace {
+    
+    using rxpromise::histogram;
+    using rxpromise::statistics;
+    
+    // Returns the upper bound of the bucket which contains the `p` quantile.
+    uint64_t quantile(uint64_t const counts[], uint64_t total, double p) {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(p * (double)total);
+        if (rank >= total) {
+            rank = total - 1;
+        }
+        uint64_t sum = 0;
+        for (unsigned i = 0; i < histogram::bucket_count; ++i) {
+            sum += counts[i];
+            if (sum > rank) {
+                return histogram::upper_bound(i);
+            }
+        }
+        return histogram::upper_bound(histogram::bucket_count - 1);
+    }
+    
+    NSDictionary* histogramDictionary(histogram const& h) {
+        uint64_t counts[histogram::bucket_count];
+        uint64_t total = 0;
+        uint64_t max = 0;
+        NSMutableArray* buckets = [[NSMutableArray alloc] initWithCapacity:histogram::bucket_count];
+        for (unsigned i = 0; i < histogram::bucket_count; ++i) {
+            counts[i] = h.bucket(i);
+            total += counts[i];
+            if (counts[i] != 0) {
+                max = histogram::upper_bound(i);
+            }
+            [buckets addObject:@(counts[i])];
+        }
+        return @{@"count":   @(total),
+                 @"p50":     @(quantile(counts, total, 0.50)),
+                 @"p99":     @(quantile(counts, total, 0.99)),
+                 @"max":     @(max),
+                 @"buckets": buckets};
+    }
+    
+}
+
+
+@implementation RXPromise (RXStatistics)
+
++ (NSDictionary*) statistics {
+#if RXPROMISE_STATISTICS
+    statistics const& stats = statistics::shared();
+    uint64_t created = stats.value(statistics::created);
+    uint64_t fulfilled = stats.value(statistics::fulfilled);
+    uint64_t rejected = stats.value(statistics::rejected);
+    uint64_t cancelled = stats.value(statistics::cancelled);
+    uint64_t resolved = fulfilled + rejected + cancelled;
+    return @{@"created":        @(created),
+             @"fulfilled":      @(fulfilled),
+             @"rejected":       @(rejected),
+             @"cancelled":      @(cancelled),
+             @"deallocated":    @(stats.value(statistics::deallocated)),
+             @"pending":        @(created > resolved ? created - resolved : 0),
+             @"dispatched":     @{@"concurrent":    @(stats.value(statistics::dispatch_concurrent)),
+                                  @"inline":        @(stats.value(statistics::dispatch_inline)),
+                                  @"queue":         @(stats.value(statistics::dispatch_queue)),
+                                  @"other":         @(stats.value(statistics::dispatch_other))},
+             @"handlerLatency": histogramDictionary(stats.handler_latency),
+             @"syncQueueWait":  histogramDictionary(stats.sync_queue_wait)};
+#else
+    return nil;
+#endif
+}
+
+
++ (void) resetStatistics {
+    statistics::shared().reset();
+}
+
+
++ (BOOL) statisticsEnabled {
+#if RXPROMISE_STATISTICS
+    return statistics::shared().enabled() ? YES : NO;
+#else
+    return NO;
+#endif
+}
+
+
++ (void) setStatisticsEnabled:(BOOL)enabled {
+    statistics::shared().set_enabled(enabled);
+}
+
+@end
@@ -0,0 +1,78 @@
+//
+//  RXPromise+RXTracing.h
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#import "RXPromise.h"
+
+/* Synopsis
+ 
+ @interface RXPromise (RXTracing)
+ 
+ + (BOOL) tracingEnabled;
+ + (void) setTracingEnabled:(BOOL)enabled;
+ + (NSData*) traceEvents;
+ + (void) clearTrace;
+ 
+ @end
+ 
+*/
+
+
+@interface RXPromise (RXTracing)
+
+/**
+ @brief Returns \c YES if life cycle events of promises are being recorded.
+ */
++ (BOOL) tracingEnabled;
+
+
+/**
+ @brief Enables or disables recording the life cycle events of promises.
+ 
+ @discussion Tracing is disabled by default. When enabled, each thread records
+ the creation, handler registration, resolution, handler execution and cancellation
+ of promises into its own ring buffer of \c RXPROMISE_TRACE_BUFFER_SIZE events,
+ overwriting its oldest events when full.
+ 
+ @par When disabled, the cost of tracing is one load and one branch per event.
+ Has no effect if the library has been compiled with \c RXPROMISE_TRACING defined
+ as \c 0.
+ */
++ (void) setTracingEnabled:(BOOL)enabled;
+
+
+/**
+ @brief Returns the recorded events in the Chrome trace event format (JSON), which
+ can be loaded into Perfetto or \c chrome://tracing.
+ 
+ @discussion The lifetime of each promise, from its creation until it has been
+ resolved, is represented as an asynchronous slice whose id is the address of the
+ promise. The execution of handlers is represented as a slice on the thread
+ which executed it. Registration, resolution and cancellation are instant
+ events. Each event has the arguments \c promise and \c parent, and if any,
+ \c child, which is the promise returned from \p then, \p thenOn, etc.
+ 
+ @note The address of a promise may be reused once it has been deallocated.
+ */
++ (NSData*) traceEvents;
+
+
+/**
+ @brief Discards all events recorded so far.
+ */
++ (void) clearTrace;
+
+@end
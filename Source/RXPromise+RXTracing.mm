@@ -0,0 +1,119 @@
+//
+//  RXPromise+RXTracing.mm
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+
+#if (!__has_feature(objc_arc))
+#error this file requires arc enabled
+#endif
+
+#import "RXPromise+RXTracing.h"
+#import "RXPromise.h"
+#import "RXPromise+Private.h"
+#include "utility/tracer.h"
+#include <unistd.h>
+#include <cstdio>
+#include <string>
+
+
+namespace {
+    
+    using rxpromise::tracer;
+    
+    char const* stateName(uint8_t state) {
+        switch (state) {
+            case Fulfilled: return "fulfilled";
+            case Rejected:  return "rejected";
+            case Cancelled: return "cancelled";
+            default:        return "pending";
+        }
+    }
+    
+    void appendEvent(std::string& json, tracer::event const& e, int pid) {
+        char const* name;
+        char const* phase;
+        switch (e.type) {
+            case tracer::created:           name = "create";    phase = "i"; break;
+            case tracer::registered:        name = "register";  phase = "i"; break;
+            case tracer::resolved:          name = "resolve";   phase = "i"; break;
+            case tracer::handler_begin:     name = "handler";   phase = "B"; break;
+            case tracer::handler_end:       name = "handler";   phase = "E"; break;
+            case tracer::cancel_requested:  name = "cancel";    phase = "i"; break;
+            default: return;
+        }
+        char buffer[320];
+        int n = snprintf(buffer, sizeof(buffer),
+                         "%s{\"name\":\"%s\",\"cat\":\"RXPromise\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":%d,\"tid\":%llu,%s"
+                         "\"args\":{\"promise\":\"0x%llx\",\"parent\":\"0x%llx\"",
+                         json.empty() ? "" : ",\n", name, phase, e.timestamp / 1000.0, pid, (unsigned long long)e.thread,
+                         phase[0] == 'i' ? "\"s\":\"t\"," : "",
+                         (unsigned long long)e.promise, (unsigned long long)e.parent);
+        json.append(buffer, n);
+        if (e.related) {
+            n = snprintf(buffer, sizeof(buffer), ",\"child\":\"0x%llx\"", (unsigned long long)e.related);
+            json.append(buffer, n);
+        }
+        if (e.type == tracer::resolved) {
+            n = snprintf(buffer, sizeof(buffer), ",\"state\":\"%s\"", stateName(e.arg));
+            json.append(buffer, n);
+        }
+        json.append("}}");
+        if (e.type == tracer::created || e.type == tracer::resolved) {
+            // The lifetime of the promise as an asynchronous slice:
+            n = snprintf(buffer, sizeof(buffer),
+                         ",\n{\"name\":\"promise\",\"cat\":\"RXPromise\",\"ph\":\"%s\",\"id\":\"0x%llx\",\"ts\":%.3f,\"pid\":%d,\"tid\":%llu}",
+                         e.type == tracer::created ? "b" : "e", (unsigned long long)e.promise, e.timestamp / 1000.0, pid, (unsigned long long)e.thread);
+            json.append(buffer, n);
+        }
+    }
+    
+}
+
+
+@implementation RXPromise (RXTracing)
+
++ (BOOL) tracingEnabled {
+#if RXPROMISE_TRACING
+    return tracer::enabled() ? YES : NO;
+#else
+    return NO;
+#endif
+}
+
+
++ (void) setTracingEnabled:(BOOL)enabled {
+#if RXPROMISE_TRACING
+    tracer::set_enabled(enabled);
+#endif
+}
+
+
++ (NSData*) traceEvents {
+    int pid = (int)getpid();
+    std::string events;
+    tracer::for_each([&events, pid](tracer::event const& e) {
+        appendEvent(events, e, pid);
+    });
+    std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n" + events + "\n]}\n";
+    return [NSData dataWithBytes:json.data() length:json.size()];
+}
+
+
++ (void) clearTrace {
+    tracer::clear();
+}
+
+@end
@@ -18,3 +18,13 @@ FOUNDATION_EXPORT const unsigned char RXPromise_VersionString[];
 #import <RXPromise/RXPromiseHeader.h>
 #import <RXPromise/RXPromise+RXExtension.h>
 #import <RXPromise/RXSettledResult.h>
+#import <RXPromise/RXPromise+RXStatistics.h>
+#import <RXPromise/RXPromise+RXPooling.h>
+#import <RXPromise/RXPromise+RXTracing.h>
+#import <RXPromise/RXStream.h>
+#import <RXPromise/RXChannel.h>
+#import <RXPromise/RXBatcher.h>
+#import <RXPromise/RXPromiseCache.h>
+#import <RXPromise/RXPromiseGroup.h>
+#import <RXPromise/RXFuture.h>
+#import <RXPromise/RXCoroutine.h>
@@ -22,11 +22,21 @@
 
 #import "RXPromise.h"
 #import "RXPromise+Private.h"
+#if defined (__APPLE__)
 #import <CoreData/CoreData.h>
+#endif
 #import <objc/runtime.h>
 #include <dispatch/dispatch.h>
 #include <cassert>
 #include <cstdio>
+#include <atomic>
+#include <deque>
+#include <pthread.h>
+#include <sched.h>
+#include "utility/timer_service.h"
+#include "utility/pool.h"
+#include "utility/statistics.h"
+#include "utility/tracer.h"
 
 // Set default logger serverity to "Error" (logs only errors)
 #if !defined (DEBUG_LOG)
@@ -76,6 +86,7 @@
 @end
 
 
+#if defined (__APPLE__)
 #pragma mark ExecutionContext - NSManagedObjectContext
 @interface NSManagedObjectContext (RXPromise)
 - (void) rxp_dispatchBlock:(void(^)())block;
@@ -86,6 +97,7 @@
     [self performBlock:block];
 }
 @end
+#endif
 
 
 #pragma mark ExecutionContext - NSOperationQueue
@@ -103,26 +115,328 @@
 
 rxpromise::shared Shared;
 
+
+void rxpromise::dispatch_to_execution_context(id executionContext, dispatch_block_t block) {
+    if (executionContext == nil) {
+        dispatch_async(Shared.default_concurrent_queue, block);
+    }
+    else if ([executionContext conformsToProtocol:@protocol(OS_dispatch_queue)]) {
+        dispatch_async(executionContext, block);
+    }
+    else {
+        [executionContext rxp_dispatchBlock:block];
+    }
+}
+
 #pragma mark -
+namespace rxpromise {
+    
+    // NSError is immutable, thus the errors of the library's own reasons are
+    // shared by all promises.
+    
+    NSError* cancelled_error() {
+        static NSError* error = [[NSError alloc] initWithDomain:@"RXPromise" code:-1 userInfo:@{NSLocalizedFailureReasonErrorKey: @"cancelled"}];
+        return error;
+    }
+    
+    NSError* timeout_error() {
+        static NSError* error = [[NSError alloc] initWithDomain:@"RXPromise" code:-1001 userInfo:@{NSLocalizedFailureReasonErrorKey: @"timeout"}];
+        return error;
+    }
+    
+    NSError* make_rejection_error(id reason) {
+        if ([reason isKindOfClass:[NSError class]]) {
+            return reason;
+        }
+        return [[NSError alloc] initWithDomain:@"RXPromise"
+                                          code:-1000
+                                      userInfo:@{NSLocalizedFailureReasonErrorKey: reason ? reason : @""}];
+    }
+    
+    NSError* make_cancellation_error(id reason) {
+        if ([reason isKindOfClass:[NSError class]]) {
+            return reason;
+        }
+        return [[NSError alloc] initWithDomain:@"RXPromise"
+                                          code:-1
+                                      userInfo:@{NSLocalizedFailureReasonErrorKey: reason ? reason : @""}];
+    }
+    
+    namespace detail {
+        
+        // Declared in RXFuture.h.
+        void register_inline(RXPromise* promise, promise_completionHandler_t onSuccess, promise_errorHandler_t onFailure) {
+            [promise rxp_registerInlineOnSuccess:onSuccess onFailure:onFailure];
+        }
+        
+    }
+    
+}
+
 namespace {
     
-    DISPATCH_RETURNS_RETAINED
-    NSError* makeTimeoutError() {
-        return [[NSError alloc] initWithDomain:@"RXPromise" code:-1001 userInfo:@{NSLocalizedFailureReasonErrorKey: @"timeout"}];
+    // A promise which is in state `Resolving` is considered pending.
+    inline RXPromise_State publicState(RXPromise_State state) {
+        return state == Resolving ? Pending : state;
     }
     
     
-    DISPATCH_RETURNS_RETAINED
-    inline dispatch_queue_t createHandlerQueue(bool suspended, void* tag)  {
-        char buffer[64];
-        snprintf(buffer, sizeof(buffer),"RXPromise.handler_queue-%p", tag);
-        dispatch_queue_t handler_queue = dispatch_queue_create(buffer, NULL);
-        assert(handler_queue);
-        dispatch_set_target_queue(handler_queue, Shared.sync_queue);
-        if (suspended) {
-            dispatch_suspend(handler_queue);
-        }
-        return handler_queue;
+    
+    // A continuation is a node of an intrusive singly-linked list of records
+    // which will be invoked once when the promise will be resolved. It is either
+    // a block, or the handlers registered with `then`, `thenOn`, etc. - which
+    // saves copying a wrapper block per handler.
+    struct continuation : rxpromise::pooled<continuation> {
+        explicit continuation(dispatch_block_t b)
+        : next(nullptr), block(b)
+        {}
+        
+        continuation(RXPromise* p, id executionContext,
+                     promise_completionHandler_t onSuccess,
+                     promise_errorHandler_t onFailure,
+                     RXPromise* returnedPromise)
+        :   next(nullptr), promise(p), execution_context(executionContext),
+            on_success(onSuccess), on_failure(onFailure), returned_promise(returnedPromise)
+        {}
+        
+        continuation*               next;
+        dispatch_block_t            block;
+        RXPromise*                  promise;    // retains the promise until it has been resolved
+        id                          execution_context;
+        promise_completionHandler_t on_success;
+        promise_errorHandler_t      on_failure;
+        __weak RXPromise*           returned_promise;
+    };
+    
+    // Marks the list of continuations as "closed": the promise has been resolved
+    // and all continuations have been invoked. Continuations added to a closed
+    // list will be invoked immediately.
+    inline continuation* closedContinuations() {
+        return reinterpret_cast<continuation*>(uintptr_t(0x1));
+    }
+    
+    // Marks the list of continuations as "draining": the resolver is currently
+    // invoking the continuations. Continuations added meanwhile will be pushed
+    // onto the list and invoked by the resolver, which preserves their order.
+    inline continuation* drainingContinuations() {
+        return reinterpret_cast<continuation*>(uintptr_t(0x2));
+    }
+    
+    inline bool isEndOfContinuations(continuation* c) {
+        return c == nullptr || c == drainingContinuations();
+    }
+    
+    
+    // The execution context of handlers registered with `thenInline`.
+    id inlineExecutionContext() {
+        static id context = [[NSObject alloc] init];
+        return context;
+    }
+    
+    // The per thread state of inline handler invocations.
+    struct inline_context {
+        unsigned                        depth;
+        std::deque<dispatch_block_t>    deferred;
+    };
+    
+    void destroyInlineContext(void* context) {
+        delete static_cast<inline_context*>(context);
+    }
+    
+    inline_context* currentInlineContext() {
+        static pthread_key_t key;
+        static pthread_once_t once = PTHREAD_ONCE_INIT;
+        pthread_once(&once, []{ pthread_key_create(&key, destroyInlineContext); });
+        inline_context* context = static_cast<inline_context*>(pthread_getspecific(key));
+        if (context == nullptr) {
+            context = new inline_context{0, {}};
+            pthread_setspecific(key, context);
+        }
+        return context;
+    }
+    
+    // Invokes the block on the current thread. If the block would exceed the
+    // maximum depth of nested inline invocations, it will be deferred until the
+    // outermost inline invocation on the current thread returns.
+    void invokeInline(dispatch_block_t block) {
+        inline_context* context = currentInlineContext();
+        if (context->depth >= RXPROMISE_INLINE_MAX_DEPTH) {
+            context->deferred.push_back(block);
+            return;
+        }
+        ++context->depth;
+        block();
+        if (context->depth == 1) {
+            while (!context->deferred.empty()) {
+                dispatch_block_t next = context->deferred.front();
+                context->deferred.pop_front();
+                next();
+            }
+        }
+        --context->depth;
+    }
+    
+    
+    // The list of children ("returned promises") of a promise. A child is
+    // referenced weakly. Entries whose child has been deallocated will be
+    // removed when the list grows beyond a threshold, which doubles the number
+    // of live children after each compaction. Thus, a long-lived parent does
+    // not accumulate dead entries, while the amortized cost of adding a child
+    // remains O(1).
+    //
+    // The list is protected by a spin lock, which is only held for a short
+    // time. Children will be cancelled outside the lock.
+    //
+    // When the list will be destroyed, its entries will be released later on
+    // a background queue, batched with the entries of other destroyed lists.
+    // Thus, deallocating a promise never waits.
+    class children {
+    public:
+        children() : head_(nullptr), count_(0), threshold_(min_threshold), locked_(false) {}
+        
+        ~children() {
+            if (head_) {
+                release_deferred(head_);
+            }
+        }
+        
+        children(children const&) = delete;
+        children& operator=(children const&) = delete;
+        
+        void add(RXPromise* child) {
+            link* l = new link(nullptr, child);
+            lock();
+            l->next = head_;
+            head_ = l;
+            if (++count_ >= threshold_) {
+                compact();
+            }
+            unlock();
+        }
+        
+        // Removes all entries and returns the children which are still alive.
+        NSArray* take() {
+            lock();
+            link* head = head_;
+            head_ = nullptr;
+            count_ = 0;
+            threshold_ = min_threshold;
+            unlock();
+            NSMutableArray* result = [[NSMutableArray alloc] init];
+            for (link* l = head; l; l = l->next) {
+                RXPromise* child = l->child;
+                if (child) {
+                    [result addObject:child];
+                }
+            }
+            clear(head);
+            return result;
+        }
+        
+        // Returns the children which are still alive.
+        NSArray* snapshot() {
+            NSMutableArray* result = [[NSMutableArray alloc] init];
+            lock();
+            for (link* l = head_; l; l = l->next) {
+                RXPromise* child = l->child;
+                if (child) {
+                    [result addObject:child];
+                }
+            }
+            unlock();
+            return result;
+        }
+        
+    private:
+        struct link : rxpromise::pooled<link> {
+            link(link* n, RXPromise* c) : next(n), child(c) {}
+            
+            link*               next;
+            __weak RXPromise*   child;
+        };
+        
+        static constexpr std::size_t min_threshold = 32;
+        
+        void lock() {
+            while (locked_.exchange(true, std::memory_order_acquire)) {
+                sched_yield();
+            }
+        }
+        
+        void unlock() {
+            locked_.store(false, std::memory_order_release);
+        }
+        
+        // Requires the lock.
+        void compact() {
+            link** pp = &head_;
+            while (link* l = *pp) {
+                if (l->child == nil) {
+                    *pp = l->next;
+                    delete l;
+                    --count_;
+                }
+                else {
+                    pp = &l->next;
+                }
+            }
+            threshold_ = 2 * count_ > min_threshold ? 2 * count_ : min_threshold;
+        }
+        
+        static void clear(link* l) {
+            while (l) {
+                link* next = l->next;
+                delete l;
+                l = next;
+            }
+        }
+        
+        // The entries of destroyed lists which have not yet been released.
+        static std::atomic<link*>& garbage() {
+            static std::atomic<link*> head(nullptr);
+            return head;
+        }
+        
+        // Prepends the entries to the garbage list. The first list which has been
+        // added to an empty garbage list schedules the release of all entries.
+        static void release_deferred(link* head) {
+            link* tail = head;
+            while (tail->next) {
+                tail = tail->next;
+            }
+            link* old = garbage().load(std::memory_order_relaxed);
+            do {
+                tail->next = old;
+            } while (!garbage().compare_exchange_weak(old, head, std::memory_order_release, std::memory_order_relaxed));
+            if (old == nullptr) {
+                dispatch_async_f(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), nullptr, &release_garbage);
+            }
+        }
+        
+        static void release_garbage(void*) {
+            clear(garbage().exchange(nullptr, std::memory_order_acquire));
+        }
+        
+        link*               head_;
+        std::size_t         count_;
+        std::size_t         threshold_;
+        std::atomic<bool>   locked_;
+    };
+    
+    
+    // Submits the block with a barrier to the sync queue of the shard. For a
+    // sampled submission, the block will be wrapped in order to record the time
+    // until it starts executing; other submissions are not wrapped.
+    void dispatchBarrierAsyncToShard(rxpromise::shared::shard* shard, dispatch_block_t block) {
+        uint64_t submitted = RXP_STATS_SAMPLE();
+        if (submitted != 0) {
+            dispatch_block_t b = block;
+            block = ^{
+                RXP_STATS_RECORD(sync_queue_wait, submitted);
+                b();
+            };
+        }
+        dispatch_barrier_async(shard->sync_queue, block);
     }
  
 }
@@ -138,11 +452,30 @@ namespace {
 
 
 
+// State transitions:
+//
+// A promise will be resolved exactly once, from any thread: the resolver first
+// claims the promise via a compare-and-swap from `Pending` to `Resolving`, then
+// it stores the result and finally publishes the final state with release
+// semantics. Readers load the state with acquire semantics and may only read
+// the result when the state is neither `Pending` nor `Resolving`. Thus, querying
+// the state and result never requires to dispatch to the sync queue.
+//
+// Handlers are registered as continuations which will be pushed onto a lock-free
+// list (LIFO) with a compare-and-swap. Once the final state has been published,
+// the resolver takes the whole list, and invokes the continuations in the order
+// they have been registered (see `rxp_runContinuations`). Thus, registering a
+// handler neither requires to dispatch to the sync queue nor to allocate a
+// dispatch queue per promise.
 @implementation RXPromise {
     RXPromise*          _parent;
-    dispatch_queue_t    _handler_queue;  // a serial queue, uses target queue: s_sync_queue
+    rxpromise::shared::shard* _shard;    // the shard whose sync queue protects the receiver
+    std::atomic<continuation*> _continuations;
+    children            _children;
     id                  _result;
-    RXPromise_State     _state;
+    std::atomic<void*>  _boxedReason;   // the retained NSError of a reason which is not a NSError, see `rxp_result`
+    bool                _needsBoxing;   // `_result` is a rejection or cancellation reason which is not a NSError
+    std::atomic<RXPromise_State> _state;
 }
 @synthesize result = _result;
 @synthesize parent = _parent;
@@ -151,19 +484,18 @@ namespace {
 
 - (void) dealloc {
     DLogInfo(@"dealloc: %p", (__bridge void*)self);
-    if (_handler_queue) {
-        if (_state == Pending) {
-            DLogWarn(@"handlers not signaled");
-            dispatch_resume(_handler_queue);
-        }
-    }
-    void const* key = (__bridge void const*)(self);
-    if (dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id) {
-        Shared.assocs.erase(key);
-    } else {
-        dispatch_barrier_sync(Shared.sync_queue, ^{
-            Shared.assocs.erase(key);
-        });
+    RXP_STATS_COUNT(deallocated);
+    if (void* boxed = _boxedReason.load(std::memory_order_acquire)) {
+        (void)(__bridge_transfer NSError*)boxed;
+    }
+    continuation* c = _continuations.load(std::memory_order_acquire);
+    if (!isEndOfContinuations(c) && c != closedContinuations()) {
+        DLogWarn(@"handlers not signaled");
+        while (!isEndOfContinuations(c)) {
+            continuation* next = c->next;
+            delete c;
+            c = next;
+        }
     }
 }
 
@@ -171,19 +503,19 @@ namespace {
 
 
 - (BOOL) isPending {
-    return _state == Pending ? YES : NO;
+    return publicState(_state.load(std::memory_order_acquire)) == Pending ? YES : NO;
 }
 
 - (BOOL) isFulfilled {
-    return _state == Fulfilled ? YES : NO;
+    return _state.load(std::memory_order_acquire) == Fulfilled ? YES : NO;
 }
 
 - (BOOL) isRejected {
-    return ((_state & Rejected) != 0) ? YES : NO;
+    return ((_state.load(std::memory_order_acquire) & Rejected) != 0) ? YES : NO;
 }
 
 - (BOOL) isCancelled {
-    return _state == Cancelled ? YES : NO;
+    return _state.load(std::memory_order_acquire) == Cancelled ? YES : NO;
 }
 
 
@@ -196,40 +528,42 @@ namespace {
 }
 
 
+- (dispatch_queue_t) syncQueue {
+    return _shard->sync_queue;
+}
+
+
 - (RXPromise_StateAndResult) peakStateAndResult {
-    if (dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id) {
-        return {_state, _result};
-    }
-    else {
-        __block RXPromise_StateAndResult result;
-        dispatch_sync(Shared.sync_queue, ^{
-            result.result = _result;
-            result.state = _state;
-        });
-        return result;
-    }
+    RXPromise_State state = publicState(_state.load(std::memory_order_acquire));
+    return {state, state != Pending ? [self rxp_result] : nil};
 }
 
 
 - (RXPromise_StateAndResult) synced_peakStateAndResult {
-    assert(dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id);
-    return {_state, _result};
+    assert(rxpromise::shared::current_shard() == _shard);
+    return [self peakStateAndResult];
 }
 
 - (id) synced_peakResult {
-    assert(dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id);
-    assert(_state != Pending);
-    return _result;
+    assert(rxpromise::shared::current_shard() == _shard);
+    assert(publicState(_state.load(std::memory_order_acquire)) != Pending);
+    return [self rxp_result];
 }
 
 
 
 - (void) cancel {
-    [self cancelWithReason:@"cancelled"];
+    [self cancelWithReason:rxpromise::cancelled_error()];
 }
 
 - (void) cancelWithReason:(id)reason {
-    dispatch_barrier_async(Shared.sync_queue, ^{  // async, in order to be less prone to dead locks
+    RXP_TRACE(rxpromise::tracer::cancel_requested, (__bridge void*)self, (__bridge void*)_parent);
+    if ([self rxp_settleWithState:Cancelled reason:reason]) {
+        DLogDebug(@"cancelled %p.", (__bridge void*)(self));
+        return;
+    }
+    // The receiver is already resolved: forward the cancellation to the children.
+    dispatchBarrierAsyncToShard(_shard, ^{  // async, in order to be less prone to dead locks
         [self synced_cancelWithReason:reason];
     });
 }
@@ -240,27 +574,18 @@ namespace {
         return self;
     }
     else if (timeout == 0) {
-        [self rejectWithReason:makeTimeoutError()];
+        [self rejectWithReason:rxpromise::timeout_error()];
         return self;
     }
-    dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, Shared.sync_queue);
-    dispatch_source_set_event_handler(timer, ^{
-        dispatch_source_cancel(timer); // one shot timer
-        [self rejectWithReason:makeTimeoutError()];
+    // The timer retains the receiver until it fires or it will be cancelled
+    // when the receiver will be resolved:
+    rxpromise::timer_service* service = &rxpromise::timer_service::shared();
+    rxpromise::timer_service::timer* timer = service->schedule((uint64_t)(timeout * NSEC_PER_SEC), ^{
+        [self rejectWithReason:rxpromise::timeout_error()];
     });
-    dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(timeout * NSEC_PER_SEC)),
-                              DISPATCH_TIME_FOREVER /*one shot*/, 0 /*_leeway*/);
-    dispatch_resume(timer);
-
-    id executionContext = Shared.sync_queue;
-    [self registerWithExecutionContext:executionContext onSuccess:^id(id result) {
-        dispatch_source_cancel(timer);
-        return nil;
-    }  onFailure:^id(NSError *error) {
-        dispatch_source_cancel(timer);
-        return nil;
-    }
-    returnPromise:NO];
+    [self rxp_addContinuation:^{
+        service->cancel(timer);
+    }];
 
     return self;
 }
@@ -268,7 +593,7 @@ namespace {
 
 
 - (void) synced_resolveWithResult:(id)result {
-    assert(dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id);
+    assert(rxpromise::shared::current_shard() == _shard);
     if (result == nil) {
         [self synced_fulfillWithValue:nil];
     }
@@ -278,69 +603,197 @@ namespace {
 }
 
 
-- (void) synced_fulfillWithValue:(id)result {
-    assert(dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id);
-    if (_state != Pending) {
-        return;
+// Atomically transitions the receiver from state `Pending` to `state` with
+// result `result`. Returns NO if the receiver has already been resolved or if
+// another resolver won the race. May be invoked from any thread.
+- (BOOL) rxp_settleWithState:(RXPromise_State)state result:(id)result {
+    assert(state == Fulfilled || state == Rejected || state == Cancelled);
+    RXPromise_State expected = Pending;
+    if (!_state.compare_exchange_strong(expected, Resolving, std::memory_order_acquire, std::memory_order_relaxed)) {
+        return NO;
     }
+    return [self rxp_publishState:state result:result];
+}
+
+
+// Stores the result, publishes the final state and runs the continuations.
+// Requires that the caller claimed the receiver.
+- (BOOL) rxp_publishState:(RXPromise_State)state result:(id)result {
     _result = result;
-    _state = Fulfilled;
-    if (_handler_queue) {
-        dispatch_resume(_handler_queue);
+    _state.store(state, std::memory_order_release);
+    RXP_TRACE(rxpromise::tracer::resolved, (__bridge void*)self, (__bridge void*)_parent, nullptr, uint8_t(state));
+    if (RXP_STATS_ENABLED()) {
+        rxpromise::statistics::shared().count(state == Fulfilled ? rxpromise::statistics::fulfilled
+                                              : state == Rejected ? rxpromise::statistics::rejected
+                                              : rxpromise::statistics::cancelled);
     }
+    [self rxp_runContinuations];
+    return YES;
 }
 
 
-- (void) synced_rejectWithReason:(id)reason {
-    assert(dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id);
-    if (_state != Pending) {
-        return;
+// Like `rxp_settleWithState:result:` with a rejection or cancellation reason.
+// A reason which is not a NSError will be stored as is, and the NSError will
+// only be created when the result will be observed (see `rxp_result`). Thus,
+// rejecting or cancelling a promise whose result will never be observed does
+// not allocate.
+- (BOOL) rxp_settleWithState:(RXPromise_State)state reason:(id)reason {
+    assert(state == Rejected || state == Cancelled);
+    RXPromise_State expected = Pending;
+    if (!_state.compare_exchange_strong(expected, Resolving, std::memory_order_acquire, std::memory_order_relaxed)) {
+        return NO;
     }
-    if (![reason isKindOfClass:[NSError class]]) {
-        reason = [[NSError alloc] initWithDomain:@"RXPromise"
-                                            code:-1000
-                                        userInfo:@{NSLocalizedFailureReasonErrorKey: reason ? reason : @""}];
+    _needsBoxing = ![reason isKindOfClass:[NSError class]];
+    return [self rxp_publishState:state result:reason];
+}
+
+
+// Returns the result of the resolved receiver. Creates the NSError of a
+// reason which is not a NSError on first use. May be invoked concurrently:
+// the first error which will be stored wins.
+- (id) rxp_result {
+    if (!_needsBoxing) {
+        return _result;
     }
-    _result = reason;
-    _state = Rejected;
-    if (_handler_queue) {
-        dispatch_resume(_handler_queue);
+    void* boxed = _boxedReason.load(std::memory_order_acquire);
+    if (boxed == nullptr) {
+        NSError* error = _state.load(std::memory_order_acquire) == Cancelled ? rxpromise::make_cancellation_error(_result) : rxpromise::make_rejection_error(_result);
+        void* retained = (__bridge_retained void*)error;
+        if (_boxedReason.compare_exchange_strong(boxed, retained, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            boxed = retained;
+        }
+        else {
+            (void)(__bridge_transfer NSError*)retained;
+        }
     }
+    return (__bridge NSError*)boxed;
 }
 
 
-- (void) synced_cancelWithReason:(id)reason {
-    assert(dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id);
-    if (_state == Cancelled) {
+// Adds a continuation to the receiver's list of continuations. If the receiver
+// has already been resolved, the block will be invoked immediately on the
+// current thread. Otherwise, it will be invoked by the resolver. The block will
+// be invoked exactly once. May be invoked from any thread.
+- (void) rxp_addContinuation:(dispatch_block_t)block {
+    if (_continuations.load(std::memory_order_acquire) == closedContinuations()) {
+        block();
         return;
     }
-    if (![reason isKindOfClass:[NSError class]]) {
-        reason = [[NSError alloc] initWithDomain:@"RXPromise"
-                                            code:-1
-                                        userInfo:@{NSLocalizedFailureReasonErrorKey: reason ? reason : @""}];
+    continuation* node = new continuation(block);
+    if (![self rxp_pushContinuation:node]) {
+        [self rxp_invokeContinuation:node];
     }
-    if (_state == Pending) {
-        DLogDebug(@"cancelled %p.", (__bridge void*)(self));
-        _result = reason;
-        _state = Cancelled;
-        if (_handler_queue) {
-            dispatch_resume(_handler_queue);
+}
+
+
+// Pushes the continuation onto the receiver's list of continuations. Returns
+// NO if the list has been closed, in which case the caller must invoke the
+// continuation.
+- (BOOL) rxp_pushContinuation:(continuation*)node {
+    continuation* head = _continuations.load(std::memory_order_acquire);
+    do {
+        if (head == closedContinuations()) {
+            return NO;
         }
+        node->next = head;
+    } while (!_continuations.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_acquire));
+    return YES;
+}
+
+
+// Invokes and destroys the continuation.
+- (void) rxp_invokeContinuation:(continuation*)node {
+    if (node->block) {
+        dispatch_block_t block = node->block;
+        delete node;
+        block();
     }
     else {
-        // We cancelled the promise at a time as it already was resolved.
-        // That means, the _handler_queue is gone and we cannot forward the
-        // cancellation event to any child ("returnedPromise") anymore.
-        // In order to cancel the possibly already resolved children promises,
-        // we need to send cancel to each promise in the children list:
-        void const* key = (__bridge void const*)(self);
-        auto range = Shared.assocs.equal_range(key);
-        while (range.first != range.second) {
-            DLogDebug(@"%p forwarding cancel to %p", key, (__bridge void*)((*(range.first)).second));
-            [(*(range.first)).second cancelWithReason:reason];
-            ++range.first;
+        [self rxp_dispatchHandlerToExecutionContext:node->execution_context
+                                          onSuccess:node->on_success
+                                          onFailure:node->on_failure
+                                    returnedPromise:node->returned_promise];
+        delete node;
+    }
+}
+
+
+// Invokes all continuations in the order they have been added. Must be invoked
+// exactly once, after the final state has been published.
+//
+// Continuations which will be added while the list is being drained will be
+// pushed onto the list, too, and will be invoked after the ones taken before.
+// Only when the resolver finds no more continuations, it closes the list.
+- (void) rxp_runContinuations {
+    // Continuations may hold the last reference to the receiver:
+    NS_VALID_UNTIL_END_OF_SCOPE RXPromise* strongSelf = self;
+    continuation* head = _continuations.exchange(drainingContinuations(), std::memory_order_acq_rel);
+    for (;;) {
+        // Reverse the list in order to invoke the continuations in FIFO order:
+        continuation* list = nullptr;
+        while (!isEndOfContinuations(head)) {
+            continuation* next = head->next;
+            head->next = list;
+            list = head;
+            head = next;
+        }
+        while (list) {
+            continuation* next = list->next;
+            [strongSelf rxp_invokeContinuation:list];
+            list = next;
+        }
+        continuation* expected = drainingContinuations();
+        if (_continuations.compare_exchange_strong(expected, closedContinuations(), std::memory_order_acq_rel, std::memory_order_acquire)) {
+            break;
         }
-        Shared.assocs.erase(key);
+        head = _continuations.exchange(drainingContinuations(), std::memory_order_acq_rel);
+    }
+}
+
+
+- (void) synced_fulfillWithValue:(id)result {
+    assert(rxpromise::shared::current_shard() == _shard);
+    [self rxp_settleWithState:Fulfilled result:result];
+}
+
+
+- (void) synced_rejectWithReason:(id)reason {
+    assert(rxpromise::shared::current_shard() == _shard);
+    [self rxp_settleWithState:Rejected reason:reason];
+}
+
+
+- (void) synced_cancelWithReason:(id)reason {
+    assert(rxpromise::shared::current_shard() == _shard);
+    if (_state.load(std::memory_order_acquire) == Cancelled) {
+        return;
+    }
+    reason = rxpromise::make_cancellation_error(reason);
+    if ([self rxp_settleWithState:Cancelled result:reason]) {
+        DLogDebug(@"cancelled %p.", (__bridge void*)(self));
+        return;
+    }
+    RXPromise_State state = _state.load(std::memory_order_acquire);
+    if (state == Resolving) {
+        // Another resolver claimed the promise, but did not yet publish its
+        // result. Instead of waiting for it, let the resolver forward the
+        // cancellation when it runs the continuations:
+        [self rxp_addContinuation:^{
+            [self cancelWithReason:reason];
+        }];
+        return;
+    }
+    if (state == Cancelled) {
+        return;
+    }
+    // We cancelled the promise at a time as it already was resolved.
+    // That means, the continuations have been run and we cannot forward the
+    // cancellation event to any child ("returnedPromise") anymore.
+    // In order to cancel the possibly already resolved children promises,
+    // we need to send cancel to each promise in the children list:
+    for (RXPromise* child in _children.take()) {
+        DLogDebug(@"%p forwarding cancel to %p", (__bridge void*)(self), (__bridge void*)(child));
+        [child cancelWithReason:reason];
     }
 }
 
@@ -356,115 +809,135 @@ namespace {
                      returnPromise:(BOOL)returnPromise
 {
     RXPromise* returnedPromise = returnPromise ? ([[[self class] alloc] init]) : nil;
-    returnedPromise.parent = self;
-    __weak RXPromise* weakReturnedPromise = returnedPromise;
-    __block RXPromise* blockSelf = self;
+    if (returnedPromise) {
+        // The returned promise belongs to the same chain, thus it must use the
+        // same shard as its parent:
+        returnedPromise->_shard = _shard;
+        returnedPromise.parent = self;
+    }
+    RXP_TRACE(rxpromise::tracer::registered, (__bridge void*)self, (__bridge void*)_parent, (__bridge void*)returnedPromise);
     if (executionContext == nil) {
         executionContext = Shared.default_concurrent_queue;
     }
-    dispatch_block_t registerBlock = ^{
-        assert(dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id);
-        if (_handler_queue == nil) {
-            _handler_queue = createHandlerQueue(_state == Pending, (__bridge void*)self);
-        }
-        // Finally, *enqueue* a wrapper block which eventually gets invoked when the
-        // promise will be resolved:
-        dispatch_async(_handler_queue, ^{
-            // The continuation has been fired!
-            assert(executionContext);
-            // Get the state of the promise:
-            assert(dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id);
-            RXPromise_StateT promise_state = blockSelf->_state;
-            __strong id promise_result = blockSelf->_result;
-            
-            dispatch_block_t handlerBlock = ^{
-                // The handler block will be executed in the specified execution
-                // context - it can be Shared.sync_queue, too - when invoked internally!
-                // If the execution context equals the Shared.sync_queue, the block
-                // must be enqueued with a barrier! (implementation details)
-                @autoreleasepool {
-                    assert(promise_state != Pending);
-                    RXPromise_StateT state = promise_state;
-                    __strong id result = promise_result;
-                    if (state == Fulfilled && onSuccess) {
-                        result = onSuccess(blockSelf->_result);
-                    }
-                    else if (state != Fulfilled && onFailure) {
-                        result = onFailure(blockSelf->_result);
+    if (_continuations.load(std::memory_order_acquire) == closedContinuations()) {
+        // Fast path: the receiver has been resolved and all previously registered
+        // handlers have been dispatched. Dispatch the handler directly:
+        [self rxp_dispatchHandlerToExecutionContext:executionContext
+                                          onSuccess:onSuccess
+                                          onFailure:onFailure
+                                    returnedPromise:returnedPromise];
+        return returnedPromise;
+    }
+    // Finally, add a continuation which eventually gets invoked when the
+    // promise will be resolved:
+    continuation* node = new continuation(self, executionContext, onSuccess, onFailure, returnedPromise);
+    if (![self rxp_pushContinuation:node]) {
+        [self rxp_invokeContinuation:node];
+    }
+    return returnedPromise;
+}
+
+
+// Dispatches the handler to the execution context. The returned promise (if
+// any) will be resolved with the return value of the handler. The receiver
+// must be resolved.
+- (void) rxp_dispatchHandlerToExecutionContext:(id)executionContext
+                                     onSuccess:(promise_completionHandler_t)onSuccess
+                                     onFailure:(promise_errorHandler_t)onFailure
+                               returnedPromise:(RXPromise*)returnedPromise
+{
+    assert(executionContext);
+    // Get the state of the promise:
+    RXPromise_StateT promise_state = _state.load(std::memory_order_acquire);
+    assert(publicState(promise_state) != Pending);
+    __strong id promise_result = [self rxp_result];
+    __weak RXPromise* weakReturnedPromise = returnedPromise;
+    uint64_t dispatched = RXP_STATS_SAMPLE();
+    void const* returnedPromiseID = (__bridge void*)returnedPromise;
+    
+    dispatch_block_t handlerBlock = ^{
+        // The handler block will be executed in the specified execution
+        // context - it can be a sync queue, too - when invoked internally!
+        // If the execution context equals a sync queue, the block must be
+        // enqueued with a barrier! (implementation details)
+        RXP_STATS_RECORD(handler_latency, dispatched);
+        @autoreleasepool {
+            RXPromise_StateT state = promise_state;
+            __strong id result = promise_result;
+            RXP_TRACE(rxpromise::tracer::handler_begin, (__bridge void*)self, (__bridge void*)self->_parent, returnedPromiseID);
+            if (state == Fulfilled && onSuccess) {
+                result = onSuccess(promise_result);
+            }
+            else if (state != Fulfilled && onFailure) {
+                result = onFailure(promise_result);
+            }
+            RXP_TRACE(rxpromise::tracer::handler_end, (__bridge void*)self, (__bridge void*)self->_parent, returnedPromiseID);
+            RXPromise* strongReturnedPromise = weakReturnedPromise;
+            if (strongReturnedPromise) {
+                assert(result != strongReturnedPromise); // @"cyclic promise error");
+                if (state == Cancelled) {
+                    [strongReturnedPromise cancelWithReason:result];
+                }
+                else {
+                    DLogInfo(@"%p add child %p", (__bridge void*)(self), (__bridge void*)(strongReturnedPromise));
+                    self->_children.add(strongReturnedPromise);
+                    //  §2.2: if parent is fulfilled, fulfill the "returned promise" with the same value
+                    //  §2.3: if parent is rejected, reject the "returned promise" with the same value.
+                    //
+                    // There are four cases how the "returned promise" (child) will be resolved:
+                    // 1. result isKindOfClass NSError   -> rejected with reason error
+                    // 2. result isKindOfClass RXPromise -> fulFilled with promise
+                    // 3. result equals nil              -> fulFilled with nil
+                    // 4  result is any other object     -> fulFilled with value
+                    //
+                    // Note: if parent is cancelled, the "returned promise" will NOT be cancelled - it just adopts the error reason!
+                    if (result && [result isKindOfClass:[NSError class]]) {
+                        [strongReturnedPromise rejectWithReason:result];
                     }
-                    RXPromise* strongReturnedPromise = weakReturnedPromise;
-                    if (strongReturnedPromise) {
-                        assert(result != strongReturnedPromise); // @"cyclic promise error");
-                        if (state == Cancelled) {
-                            [strongReturnedPromise cancelWithReason:result];
-                        }
-                        else {
-                            DLogInfo(@"%p add child %p", (__bridge void*)(blockSelf), (__bridge void*)(strongReturnedPromise));
-                            if (executionContext == Shared.sync_queue) {
-                                // prerequiste: the block must have been enqueued with a barrier!
-                                Shared.assocs.emplace((__bridge void*)(blockSelf), weakReturnedPromise);
-                            } else {
-                                void const* parent_pointer = (__bridge void*)(blockSelf);
-                                dispatch_barrier_async(Shared.sync_queue, ^{  // TODO:
-                                    Shared.assocs.emplace(parent_pointer, weakReturnedPromise);
-                                }); 
-                            }
-                            //  §2.2: if parent is fulfilled, fulfill the "returned promise" with the same value
-                            //  §2.3: if parent is rejected, reject the "returned promise" with the same value.
-                            //
-                            // There are four cases how the "returned promise" (child) will be resolved:
-                            // 1. result isKindOfClass NSError   -> rejected with reason error
-                            // 2. result isKindOfClass RXPromise -> fulFilled with promise
-                            // 3. result equals nil              -> fulFilled with nil
-                            // 4  result is any other object     -> fulFilled with value
-                            //
-                            // Note: if parent is cancelled, the "returned promise" will NOT be cancelled - it just adopts the error reason!
-                            if (result && [result isKindOfClass:[NSError class]]) {
-                                [strongReturnedPromise rejectWithReason:result];
-                            }
-                            else if (result && [result isKindOfClass:[RXPromise class]]) {
-                                [strongReturnedPromise bind:result];
-                            }
-                            else {
-                                [strongReturnedPromise fulfillWithValue:result];
-                            }
-                        }
+                    else if (result && [result isKindOfClass:[RXPromise class]]) {
+                        [strongReturnedPromise bind:result];
                     }
                     else {
-                        DLogInfo(@"parent's  %p returned promisze %p died", (__bridge void*)(blockSelf), (__bridge void*)(strongReturnedPromise));
+                        [strongReturnedPromise fulfillWithValue:result];
                     }
-                    blockSelf = nil;
-                }//@autoreleasepool
-            };
-            
-            if (executionContext == Shared.default_concurrent_queue) {
-                // If the continuation has been registered with `then`, we run
-                // the handler is parallel:
-                dispatch_async(executionContext, handlerBlock);
-            }
-            else if ([executionContext conformsToProtocol:@protocol(OS_dispatch_queue)]) {
-                // If the continuation has been registered with `thenOn:` and when the
-                // execution context is a dispatch queue, we run the handler serially:
-                dispatch_barrier_async(executionContext, handlerBlock);
+                }
             }
             else {
-                // Otherwise, the execution context is not a dispatch_queue. Dispatch
-                // to the corresponding execution context:
-                [executionContext rxp_dispatchBlock:handlerBlock];
+                DLogInfo(@"parent's  %p returned promisze %p died", (__bridge void*)(self), (__bridge void*)(strongReturnedPromise));
             }
-        });
+        }//@autoreleasepool
     };
     
-    if (dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id) {
-        // when entering here, we need to ensure the block has been dispatched with a barrier!
-        // (currently, this path only gets executed when invoking `resolveWithResult:` and `bind:`)
-        registerBlock();
+    if (executionContext == Shared.default_concurrent_queue) {
+        // If the continuation has been registered with `then`, we run
+        // the handler is parallel:
+        RXP_STATS_COUNT(dispatch_concurrent);
+        dispatch_async(executionContext, handlerBlock);
+    }
+    else if (executionContext == inlineExecutionContext()) {
+        // If the continuation has been registered with `thenInline`, we run
+        // the handler on the current thread - unless we are executing on a
+        // sync queue, where no client code must be executed:
+        RXP_STATS_COUNT(dispatch_inline);
+        if (rxpromise::shared::current_shard() == NULL) {
+            invokeInline(handlerBlock);
+        }
+        else {
+            dispatch_async(Shared.default_concurrent_queue, handlerBlock);
+        }
+    }
+    else if ([executionContext conformsToProtocol:@protocol(OS_dispatch_queue)]) {
+        // If the continuation has been registered with `thenOn:` and when the
+        // execution context is a dispatch queue, we run the handler serially:
+        RXP_STATS_COUNT(dispatch_queue);
+        dispatch_barrier_async(executionContext, handlerBlock);
     }
     else {
-        assert(Shared.sync_queue);
-        dispatch_barrier_sync(Shared.sync_queue, registerBlock);
+        // Otherwise, the execution context is not a dispatch_queue. Dispatch
+        // to the corresponding execution context:
+        RXP_STATS_COUNT(dispatch_other);
+        [executionContext rxp_dispatchBlock:handlerBlock];
     }
-    return returnedPromise;
 }
 
 
@@ -482,6 +955,30 @@ namespace {
 }
 
 
+- (then_block_t) thenInline {
+    return ^RXPromise*(promise_completionHandler_t onSuccess, promise_errorHandler_t onFailure) {
+        return [self registerWithExecutionContext:inlineExecutionContext() onSuccess:onSuccess onFailure:onFailure returnPromise:YES];
+    };
+}
+
+
+- (void) rxp_registerInlineOnSuccess:(promise_completionHandler_t)onSuccess onFailure:(promise_errorHandler_t)onFailure {
+    [self registerWithExecutionContext:inlineExecutionContext() onSuccess:onSuccess onFailure:onFailure returnPromise:NO];
+}
+
+
+- (BOOL) rxp_fulfillWithValue:(id)value {
+    assert(![value isKindOfClass:[NSError class]]);
+    return [self rxp_settleWithState:Fulfilled result:value];
+}
+
+
+- (BOOL) rxp_cancelIfPendingWithError:(NSError*)error {
+    RXP_TRACE(rxpromise::tracer::cancel_requested, (__bridge void*)self, (__bridge void*)_parent);
+    return [self rxp_settleWithState:Cancelled result:error];
+}
+
+
 - (then_on_main_block_t) thenOnMain {
     return ^RXPromise*(promise_completionHandler_t onSuccess, promise_errorHandler_t onFailure) {
         return [self registerWithExecutionContext:dispatch_get_main_queue() onSuccess:onSuccess onFailure:onFailure returnPromise:YES];
@@ -511,33 +1008,22 @@ namespace {
 
 - (id) getWithTimeout:(NSTimeInterval)timeout
 {
-    assert(dispatch_get_specific(rxpromise::shared::QueueID) != rxpromise::shared::sync_queue_id); // Must not execute on the private sync queue!
+    assert(rxpromise::shared::current_shard() == NULL); // Must not execute on a private sync queue!
     
-    __block id result;
-    __block dispatch_semaphore_t sem = NULL;
-    dispatch_sync(Shared.sync_queue, ^{
-        if (_state != Pending) {
-            result = _result;
-        } else {
-            sem = dispatch_semaphore_create(0);
-            if (_handler_queue == nil) {
-                _handler_queue = createHandlerQueue(_state == Pending, (__bridge void*)self);
-            }
-            dispatch_async(_handler_queue, ^{
-                dispatch_semaphore_signal(sem);
-            });
-        }
-    });
-    if (sem) {
+    RXPromise_StateAndResult sr = [self peakStateAndResult];
+    id result = sr.result;
+    if (sr.state == Pending) {
         // result was not yet availbale: queue a handler
+        dispatch_semaphore_t sem = dispatch_semaphore_create(0);
+        [self rxp_addContinuation:^{
+            dispatch_semaphore_signal(sem);
+        }];
         dispatch_time_t t = timeout < 0 ? DISPATCH_TIME_FOREVER : dispatch_time(DISPATCH_TIME_NOW, (int64_t)(timeout * NSEC_PER_SEC));
-        if (dispatch_semaphore_wait(sem, t) == 0) { // wait until handler_queue will be resumed ...
-            dispatch_sync(Shared.sync_queue, ^{  // safely retrieve _result
-                result = _result;
-            });
+        if (dispatch_semaphore_wait(sem, t) == 0) { // wait until the continuations will be run ...
+            result = [self peakStateAndResult].result;
         }
         else {
-            result = makeTimeoutError();
+            result = rxpromise::timeout_error();
         }
     }
     return result;
@@ -558,6 +1044,7 @@ namespace {
     // event source, the run lopp may quickly return with the effect that the
     // while loop will "busy wait".
     
+#if defined (__APPLE__)
     static CFRunLoopSourceContext context;
 
     CFRunLoopRef runLoop = CFRunLoopGetCurrent();
@@ -579,17 +1066,24 @@ namespace {
     }
     CFRunLoopRemoveSource(runLoop, runLoopSource, kCFRunLoopDefaultMode);
     CFRelease(runLoopSource);
+#else
+    // Without CoreFoundation, poll the run loop:
+    NSRunLoop* runLoop = [NSRunLoop currentRunLoop];
+    while (self.isPending) {
+        [runLoop runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+#endif
 }
 
 
 
 - (void) bind:(RXPromise*) other
 {
-    if (dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id) {
+    if (rxpromise::shared::current_shard() == _shard) {
         [self synced_bind:other];
     }
     else {
-        dispatch_barrier_async(Shared.sync_queue, ^{
+        dispatchBarrierAsyncToShard(_shard, ^{
             [self synced_bind:other];
         });
     }
@@ -607,16 +1101,18 @@ namespace {
 // cancellation!
 - (void) synced_bind:(RXPromise*) other {
     assert(other != nil);
-    assert(dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id);
+    assert(rxpromise::shared::current_shard() == _shard);
 
-    if (_state == Cancelled) {
-        [other cancelWithReason:_result];
+    RXPromise_StateAndResult sr = [self peakStateAndResult];
+    if (sr.state == Cancelled) {
+        [other cancelWithReason:sr.result];
         return;
     }
-    if (_state != Pending) {
+    if (sr.state != Pending) {
         return;
     }
-    RXPromise_StateAndResult ps = [other synced_peakStateAndResult];
+    rxpromise::shared::shard* shard = _shard;
+    RXPromise_StateAndResult ps = [other peakStateAndResult];
     switch (ps.state) {
         case Fulfilled:
             [self synced_fulfillWithValue:ps.result];
@@ -629,13 +1125,13 @@ namespace {
             break;
         default: {
             __weak RXPromise* weakSelf = self;
-            [other registerWithExecutionContext:Shared.sync_queue onSuccess:^id(id result) {
-                assert(dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id);
+            [other registerWithExecutionContext:shard->sync_queue onSuccess:^id(id result) {
+                assert(rxpromise::shared::current_shard() == shard);
                 RXPromise* strongSelf = weakSelf;
                 [strongSelf synced_fulfillWithValue:result];
                 return nil;
             } onFailure:^id(NSError *error) {
-                assert(dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id);
+                assert(rxpromise::shared::current_shard() == shard);
                 RXPromise* strongSelf = weakSelf;
                 if (other.isCancelled)
                     [strongSelf synced_cancelWithReason:error];
@@ -648,13 +1144,18 @@ namespace {
     }
     __weak RXPromise* weakSelf = self;
     __weak RXPromise* weakOther = other;
-    [self registerWithExecutionContext:Shared.sync_queue onSuccess:nil onFailure:^id(NSError *error) {
-        assert(dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id);
+    [self registerWithExecutionContext:shard->sync_queue onSuccess:nil onFailure:^id(NSError *error) {
+        assert(rxpromise::shared::current_shard() == shard);
         RXPromise* strongSelf = weakSelf;
         if (strongSelf) {
-            if (strongSelf->_state == Cancelled) {
+            if (strongSelf.isCancelled) {
                 RXPromise* strongOther = weakOther;
-                [strongOther synced_cancelWithReason:error];
+                if (strongOther && strongOther->_shard == shard) {
+                    [strongOther synced_cancelWithReason:error];
+                }
+                else {
+                    [strongOther cancelWithReason:error];
+                }
             }
         }
         return error;
@@ -670,7 +1171,7 @@ namespace {
 
 - (NSString*) description {
     __block NSString* desc;
-    dispatch_sync(Shared.sync_queue, ^{
+    dispatch_sync(_shard->sync_queue, ^{
         desc = [self rxp_descriptionLevel:0];
     });
     return desc;
@@ -683,24 +1184,22 @@ namespace {
 
 - (NSString*) rxp_descriptionLevel:(int)level {
     NSString* indent = [NSString stringWithFormat:@"%*s",4*level,""];
+    RXPromise_State state = publicState(_state.load(std::memory_order_acquire));
     NSMutableString* desc = [[NSMutableString alloc] initWithFormat:@"%@<%@:%p> %ld { %@ }",
                              indent,
                              NSStringFromClass([self class]), (__bridge void*)self,
                              CFGetRetainCount((__bridge CFTypeRef)self),
-                             ( (_state == Fulfilled)?[NSString stringWithFormat:@"fulfilled with value: %@", _result]:
-                              (_state == Rejected)?[NSString stringWithFormat:@"rejected with reason: %@", _result]:
-                              (_state == Cancelled)?[NSString stringWithFormat:@"cancelled with reason: %@", _result]
+                             ( (state == Fulfilled)?[NSString stringWithFormat:@"fulfilled with value: %@", [self rxp_result]]:
+                              (state == Rejected)?[NSString stringWithFormat:@"rejected with reason: %@", [self rxp_result]]:
+                              (state == Cancelled)?[NSString stringWithFormat:@"cancelled with reason: %@", [self rxp_result]]
                               :@"pending")
                              ];
-    void* key = (__bridge void*)(self);
-    auto range = Shared.assocs.equal_range(key);
-    if (range.first != range.second) {
+    NSArray* children = _children.snapshot();
+    if ([children count]) {
         [desc appendString:[NSString stringWithFormat:@", children: [\n"]];
-        while (range.first != range.second) {
-            RXPromise* p = (*(range.first)).second;
-            [desc appendString:p ? [p rxp_descriptionLevel:level+1] : @"<nil>"];
+        for (RXPromise* p in children) {
+            [desc appendString:[p rxp_descriptionLevel:level+1]];
             [desc appendString:@"\n"];
-            ++range.first;
         }
         [desc appendString:[NSString stringWithFormat:@"%@]", indent]];
     }
@@ -709,12 +1208,13 @@ namespace {
 }
 
 - (NSString*) rxp_debugSummary {
-    NSString* result = [_result description];
+    RXPromise_State state = publicState(_state.load(std::memory_order_acquire));
+    NSString* result = state != Pending ? [[self rxp_result] description] : nil;
     NSMutableString* summary = [[NSMutableString alloc] initWithFormat:@"<%@>{%@}",
                                 NSStringFromClass([self class]),
-                                ( (_state == Fulfilled)?[NSString stringWithFormat:@"fulfilled with value: %@", result]:
-                                 (_state == Rejected)?[NSString stringWithFormat:@"rejected with reason: %@", result]:
-                                 (_state == Cancelled)?[NSString stringWithFormat:@"cancelled with reason: %@", result]
+                                ( (state == Fulfilled)?[NSString stringWithFormat:@"fulfilled with value: %@", result]:
+                                 (state == Rejected)?[NSString stringWithFormat:@"rejected with reason: %@", result]:
+                                 (state == Cancelled)?[NSString stringWithFormat:@"cancelled with reason: %@", result]
                                  :@"pending")
                                 ];
     return summary;
@@ -728,7 +1228,7 @@ namespace {
 @implementation RXPromise (RXResolver)
 - (void) rxp_synced_resolvePromise:(RXPromise*)promise
 {
-    assert(dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id);
+    assert(rxpromise::shared::current_shard() == promise->_shard);
     [promise synced_bind:self];
 }
 @end
@@ -833,6 +1333,11 @@ namespace {
 // 1. Designated Initializer
 - (instancetype)init {
     self = [super init];
+    if (self) {
+        _shard = Shared.shard_for((__bridge void*)self);
+        RXP_STATS_COUNT(created);
+        RXP_TRACE(rxpromise::tracer::created, (__bridge void*)self, nullptr);
+    }
     DLogInfo(@"create: %p", (__bridge void*)self);
     return self;
 }
@@ -843,8 +1348,21 @@ namespace {
     DLogInfo(@"create: %p", (__bridge void*)self);
     self = [super init];
     if (self) {
+        _shard = Shared.shard_for((__bridge void*)self);
         _result = result;
-        _state = [result isKindOfClass:[NSError class]] ? Rejected : Fulfilled;
+        _state.store([result isKindOfClass:[NSError class]] ? Rejected : Fulfilled, std::memory_order_relaxed);
+        // There is no resolver which would run the continuations, thus the list
+        // must be closed before the promise will be published:
+        _continuations.store(closedContinuations(), std::memory_order_relaxed);
+        RXP_STATS_COUNT(created);
+        RXP_TRACE(rxpromise::tracer::created, (__bridge void*)self, nullptr);
+        RXP_TRACE(rxpromise::tracer::resolved, (__bridge void*)self, nullptr, nullptr, uint8_t(_state.load(std::memory_order_relaxed)));
+        if ([result isKindOfClass:[NSError class]]) {
+            RXP_STATS_COUNT(rejected);
+        }
+        else {
+            RXP_STATS_COUNT(fulfilled);
+        }
     }
     return self;
 }
@@ -852,34 +1370,29 @@ namespace {
 #pragma mark Resolver
 
 - (void) resolveWithResult:(id)result {
-    dispatch_barrier_async(Shared.sync_queue, ^{
-        [self synced_resolveWithResult:result];
-    });
+    if ([result isKindOfClass:[RXPromise class]]) {
+        // Binding requires the sync queue:
+        dispatchBarrierAsyncToShard(_shard, ^{
+            [self synced_resolveWithResult:result];
+        });
+    }
+    else if ([result isKindOfClass:[NSError class]]) {
+        [self rejectWithReason:result];
+    }
+    else {
+        [self fulfillWithValue:result];
+    }
 }
 
 
 - (void) fulfillWithValue:(id)value {
     assert(![value isKindOfClass:[NSError class]]);
-    if (dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id) {
-        [self synced_fulfillWithValue:value];
-    }
-    else {
-        dispatch_barrier_async(Shared.sync_queue, ^{
-            [self synced_fulfillWithValue:value];
-        });
-    }
+    [self rxp_settleWithState:Fulfilled result:value];
 }
 
 
 - (void) rejectWithReason:(id)reason {
-    if (dispatch_get_specific(rxpromise::shared::QueueID) == rxpromise::shared::sync_queue_id) {
-        [self synced_rejectWithReason:reason];
-    }
-    else {
-        dispatch_barrier_async(Shared.sync_queue, ^{
-            [self synced_rejectWithReason:reason];
-        });
-    }
+    [self rxp_settleWithState:Rejected reason:reason];
 }
 
 
@@ -0,0 +1,128 @@
+//
+//  RXPromiseCache.h
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+@class RXPromise;
+
+
+/* Synopsis
+
+ @interface RXPromiseCache : NSObject
+
+ - (instancetype) initWithCapacity:(NSUInteger)capacity timeToLive:(NSTimeInterval)timeToLive;
+
+ - (RXPromise*) promiseForKey:(id<NSCopying>)key task:(RXPromise*(^)(void))task;
+ - (RXPromise*) cachedPromiseForKey:(id<NSCopying>)key;
+ - (void) removePromiseForKey:(id<NSCopying>)key;
+ - (void) removeAllPromises;
+
+ @property (nonatomic, readonly) NSUInteger capacity;
+ @property (nonatomic, readonly) NSTimeInterval timeToLive;
+ @property (nonatomic, readonly) NSUInteger count;
+
+ @end
+
+ */
+
+
+/**
+ @brief A cache of promises, which deduplicates concurrent requests for the same
+ key and retains the fulfilled promises.
+
+ @discussion When a promise for a key is requested while the task for this key
+ is still in progress, the same pending promise will be returned, and the task
+ will not be started again. A fulfilled promise will be retained until it is the
+ least recently used one when the capacity has been exceeded, until its time to
+ live elapsed, or until the system signals memory pressure. A rejected or
+ cancelled promise will be removed immediately, so the next request starts the
+ task again.
+
+ @par A cache hit returns the cached promise itself, which is already resolved.
+ It does neither allocate nor use a dispatch queue.
+
+ @par Since requesters of the same key share one promise, cancelling the pending
+ promise cancels it for all requesters.
+
+ @par All methods are thread-safe.
+ */
+@interface RXPromiseCache : NSObject
+
+/**
+ @brief Initializes a cache.
+
+ @param capacity The maximum number of fulfilled promises. Zero means unlimited.
+ Pending promises do not count.
+
+ @param timeToLive The time in seconds a fulfilled promise will be retained
+ after it has been fulfilled. Zero means unlimited. An expired promise will be
+ removed by a timer, even if its key will not be requested again.
+ */
+- (instancetype) initWithCapacity:(NSUInteger)capacity timeToLive:(NSTimeInterval)timeToLive;
+
+
+/**
+ @brief Returns the cached or pending promise for the key, or starts the task.
+
+ @discussion If there is no cached or pending promise for the key, the task will
+ be invoked synchronously on the current thread, and the returned promise will
+ be bound to the promise returned from the task.
+
+ @param key The key.
+ @param task A block which starts the asynchronous task for the key and returns
+ its promise.
+ */
+- (RXPromise*) promiseForKey:(id<NSCopying>)key task:(RXPromise*(^)(void))task;
+
+
+/**
+ @brief Returns the cached or pending promise for the key, or \c nil.
+ */
+- (RXPromise*) cachedPromiseForKey:(id<NSCopying>)key;
+
+
+/**
+ @brief Removes the promise for the key. A pending promise will not be cancelled.
+ */
+- (void) removePromiseForKey:(id<NSCopying>)key;
+
+
+/**
+ @brief Removes all promises. Pending promises will not be cancelled.
+ */
+- (void) removeAllPromises;
+
+
+/**
+ @brief The maximum number of fulfilled promises. Zero means unlimited.
+ */
+@property (nonatomic, readonly) NSUInteger capacity;
+
+
+/**
+ @brief The time in seconds a fulfilled promise will be retained. Zero means
+ unlimited.
+ */
+@property (nonatomic, readonly) NSTimeInterval timeToLive;
+
+
+/**
+ @brief The number of cached and pending promises.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+@end
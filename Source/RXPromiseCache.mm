@@ -0,0 +1,314 @@
+//
+//  RXPromiseCache.mm
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+
+#if (!__has_feature(objc_arc))
+#error this file requires arc enabled
+#endif
+
+#import "RXPromiseCache.h"
+#import "RXPromise.h"
+#import "RXPromise+Private.h"
+#include "utility/timer_service.h"
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace {
+
+    struct key_hash {
+        std::size_t operator()(id key) const { return (std::size_t)[key hash]; }
+    };
+
+    struct key_equal {
+        bool operator()(id a, id b) const { return a == b || [a isEqual:b]; }
+    };
+
+    typedef std::list<id> lru_list;
+
+    // The timer of the shared timer service which removes an entry when its
+    // time to live elapsed. It will be cancelled when the entry is destroyed.
+    class expiry_timer {
+    public:
+        expiry_timer() : timer_(nullptr) {}
+        explicit expiry_timer(rxpromise::timer_service::timer* t) : timer_(t) {}
+        expiry_timer(expiry_timer&& other) : timer_(other.timer_) { other.timer_ = nullptr; }
+        expiry_timer& operator=(expiry_timer&& other) {
+            std::swap(timer_, other.timer_);
+            return *this;
+        }
+        expiry_timer(expiry_timer const&) = delete;
+        expiry_timer& operator=(expiry_timer const&) = delete;
+
+        ~expiry_timer() {
+            if (timer_) {
+                rxpromise::timer_service::shared().cancel(timer_);
+            }
+        }
+
+    private:
+        rxpromise::timer_service::timer* timer_;
+    };
+
+    struct entry {
+        RXPromise*          promise;
+        uint64_t            expires;    // zero means never
+        bool                fulfilled;
+        lru_list::iterator  lru;        // valid if fulfilled
+        expiry_timer        timer;      // armed if fulfilled and expires
+    };
+
+    typedef std::unordered_map<id, entry, key_hash, key_equal> entry_map;
+
+    uint64_t now() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+}
+
+
+// Implementation notes:
+//
+// All state is protected by `_mutex`. The map contains the pending and the
+// fulfilled promises; the LRU list contains the keys of the fulfilled promises
+// only, most recently used first, so pending promises will never be evicted.
+// Promises which will be removed from the cache will be released after the
+// lock has been released, since the last release of a promise may execute
+// arbitrary code.
+//
+// A fulfilled promise with a time to live has a timer of the shared timer
+// service, which removes the entry when it expires, so that promises which
+// will never be requested again do not stay in memory. Destroying an entry
+// cancels its timer. Lookups check the expiry as well, since the timer may
+// fire up to one tick late.
+@implementation RXPromiseCache {
+    std::mutex          _mutex;
+    entry_map           _entries;
+    lru_list            _lru;
+    NSUInteger          _capacity;
+    NSTimeInterval      _timeToLive;
+    dispatch_source_t   _memoryPressureSource;
+}
+
+@synthesize capacity = _capacity;
+@synthesize timeToLive = _timeToLive;
+
+
+- (instancetype) init {
+    return [self initWithCapacity:0 timeToLive:0];
+}
+
+
+- (instancetype) initWithCapacity:(NSUInteger)capacity timeToLive:(NSTimeInterval)timeToLive {
+    self = [super init];
+    if (self) {
+        _capacity = capacity;
+        _timeToLive = timeToLive > 0 ? timeToLive : 0;
+#if defined (DISPATCH_SOURCE_TYPE_MEMORYPRESSURE)
+        _memoryPressureSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+                                                       DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL,
+                                                       dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0));
+        if (_memoryPressureSource) {
+            __weak RXPromiseCache* weakSelf = self;
+            dispatch_source_set_event_handler(_memoryPressureSource, ^{
+                [weakSelf rxp_purge];
+            });
+            dispatch_resume(_memoryPressureSource);
+        }
+#endif
+    }
+    return self;
+}
+
+
+- (void) dealloc {
+    if (_memoryPressureSource) {
+        dispatch_source_cancel(_memoryPressureSource);
+    }
+}
+
+
+- (RXPromise*) promiseForKey:(id<NSCopying>)key task:(RXPromise*(^)(void))task {
+    NSParameterAssert(key);
+    NSParameterAssert(task);
+    RXPromise* expired = nil;   // released after the lock
+    RXPromise* promise = nil;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _entries.find(key);
+        if (it != _entries.end()) {
+            if ([self locked_isExpired:it->second]) {
+                expired = it->second.promise;
+                _lru.erase(it->second.lru);
+                _entries.erase(it);
+            }
+            else {
+                if (it->second.fulfilled) {
+                    _lru.splice(_lru.begin(), _lru, it->second.lru);
+                }
+                return it->second.promise;
+            }
+        }
+        key = [(id)key copyWithZone:nil];
+        promise = [[RXPromise alloc] init];
+        _entries.emplace(key, entry{promise, 0, false, _lru.end(), expiry_timer()});
+    }
+    __weak RXPromiseCache* weakSelf = self;
+    __weak RXPromise* weakPromise = promise;
+    [promise rxp_registerInlineOnSuccess:^id(id result) {
+        [weakSelf rxp_didFulfillPromise:weakPromise forKey:key];
+        return nil;
+    } onFailure:^id(NSError* error) {
+        [weakSelf rxp_removePromise:weakPromise forKey:key];
+        return nil;
+    }];
+    RXPromise* taskPromise = task();
+    if (taskPromise) {
+        [promise bind:taskPromise];
+    }
+    else {
+        [promise rejectWithReason:@"task returned nil"];
+    }
+    return promise;
+}
+
+
+- (RXPromise*) cachedPromiseForKey:(id<NSCopying>)key {
+    RXPromise* expired = nil;
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _entries.find(key);
+    if (it == _entries.end()) {
+        return nil;
+    }
+    if ([self locked_isExpired:it->second]) {
+        expired = it->second.promise;
+        _lru.erase(it->second.lru);
+        _entries.erase(it);
+        return nil;
+    }
+    if (it->second.fulfilled) {
+        _lru.splice(_lru.begin(), _lru, it->second.lru);
+    }
+    return it->second.promise;
+}
+
+
+- (void) removePromiseForKey:(id<NSCopying>)key {
+    RXPromise* removed = nil;
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _entries.find(key);
+    if (it != _entries.end()) {
+        removed = it->second.promise;
+        if (it->second.fulfilled) {
+            _lru.erase(it->second.lru);
+        }
+        _entries.erase(it);
+    }
+}
+
+
+- (void) removeAllPromises {
+    entry_map removed;
+    std::lock_guard<std::mutex> lock(_mutex);
+    removed.swap(_entries);
+    _lru.clear();
+}
+
+
+- (NSUInteger) count {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+
+#pragma mark - Private
+
+// Requires the lock.
+- (BOOL) locked_isExpired:(entry const&)e {
+    return e.fulfilled && e.expires != 0 && now() >= e.expires;
+}
+
+
+- (void) rxp_didFulfillPromise:(RXPromise*)promise forKey:(id)key {
+    std::vector<RXPromise*> evicted;
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _entries.find(key);
+    if (it == _entries.end() || it->second.promise != promise) {
+        return;
+    }
+    it->second.fulfilled = true;
+    it->second.expires = _timeToLive > 0 ? now() + (uint64_t)(_timeToLive * NSEC_PER_SEC) : 0;
+    _lru.push_front(it->first);
+    it->second.lru = _lru.begin();
+    if (_timeToLive > 0) {
+        __weak RXPromiseCache* weakSelf = self;
+        __weak RXPromise* weakPromise = promise;
+        it->second.timer = expiry_timer(rxpromise::timer_service::shared().schedule((uint64_t)(_timeToLive * NSEC_PER_SEC), ^{
+            [weakSelf rxp_expirePromise:weakPromise forKey:key];
+        }));
+    }
+    while (_capacity != 0 && _lru.size() > _capacity) {
+        auto last = _entries.find(_lru.back());
+        evicted.push_back(last->second.promise);
+        _entries.erase(last);
+        _lru.pop_back();
+    }
+}
+
+
+- (void) rxp_removePromise:(RXPromise*)promise forKey:(id)key {
+    RXPromise* removed = nil;
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _entries.find(key);
+    if (it != _entries.end() && it->second.promise == promise && !it->second.fulfilled) {
+        removed = it->second.promise;
+        _entries.erase(it);
+    }
+}
+
+
+// Invoked by the expiry timer of the entry.
+- (void) rxp_expirePromise:(RXPromise*)promise forKey:(id)key {
+    RXPromise* expired = nil;
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _entries.find(key);
+    if (it != _entries.end() && it->second.promise == promise && it->second.fulfilled) {
+        expired = it->second.promise;
+        _lru.erase(it->second.lru);
+        _entries.erase(it);
+    }
+}
+
+
+// Removes all fulfilled promises. Pending promises will be kept, so that
+// concurrent requests are still deduplicated.
+- (void) rxp_purge {
+    std::vector<RXPromise*> purged;
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (id key : _lru) {
+        auto it = _entries.find(key);
+        purged.push_back(it->second.promise);
+        _entries.erase(it);
+    }
+    _lru.clear();
+}
+
+@end
@@ -0,0 +1,126 @@
+//
+//  RXPromiseGroup.h
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+@class RXPromise;
+
+
+/* Synopsis
+
+ @interface RXPromiseGroup : NSObject
+
+ - (void) addPromise:(RXPromise*)promise;
+ - (void) addPromises:(NSArray*)promises;
+ - (void) addCancellationHandler:(void(^)(NSError* reason))handler;
+
+ - (void) cancel;
+ - (void) cancelWithReason:(id)reason;
+
+ @property (nonatomic, readonly) BOOL isCancelled;
+ @property (nonatomic, readonly) NSError* cancellationReason;
+
+ @end
+
+ */
+
+
+/**
+ @brief A promise group is a cancellation token for a scope of work, for example
+ all promises and tasks belonging to one request.
+
+ @discussion Any number of promises can be added to a group. Cancelling the group
+ cancels all of its pending promises. A promise which will be added to a group
+ which has already been cancelled will be cancelled immediately. Tasks may poll
+ \p isCancelled, which is a single atomic load, or register a cancellation
+ handler.
+
+ @par Cancelling a group is a single atomic operation which marks the group as
+ cancelled and takes its members at the same time. The members will then be
+ cancelled asynchronously, by one block on a concurrent queue, directly -
+ without dispatching to a sync queue and without walking their parents. Thus,
+ the cost of \p cancelWithReason: is constant, and neither walking the members
+ nor executing their handlers happens on the cancelling thread. Promises which
+ have already been resolved will not be affected, in particular the
+ cancellation will not be forwarded to their children.
+
+ @par A group references its promises weakly. Promises which have been resolved
+ or deallocated will be removed as the group grows, so a long-lived group does
+ not accumulate them.
+
+ @par All methods are thread-safe.
+ */
+@interface RXPromiseGroup : NSObject
+
+/**
+ @brief Adds a promise to the group. If the group has already been cancelled, the
+ promise will be cancelled immediately with the reason of the group.
+ */
+- (void) addPromise:(RXPromise*)promise;
+
+
+/**
+ @brief Adds each promise of the array to the group.
+ */
+- (void) addPromises:(NSArray*)promises;
+
+
+/**
+ @brief Registers a handler which will be invoked once with the cancellation
+ reason when the group will be cancelled. If the group has already been
+ cancelled, the handler will be invoked immediately.
+
+ @discussion The handler will be invoked on a concurrent queue after the group
+ has been cancelled, or on the current thread if the group has already been
+ cancelled. It should return quickly. The group retains the handler until it
+ will be cancelled.
+ */
+- (void) addCancellationHandler:(void(^)(NSError* reason))handler;
+
+
+/**
+ @brief Cancels the group with reason \c \@"cancelled".
+ */
+- (void) cancel;
+
+
+/**
+ @brief Cancels the group and all of its pending promises. Has no effect if the
+ group has already been cancelled.
+
+ @discussion When this method returns, \p isCancelled returns \c YES and promises
+ added to the group will be cancelled immediately. The promises which have been
+ added before will be cancelled asynchronously.
+
+ @param reason The reason. It becomes the error reason of the cancelled promises,
+ like in \p cancelWithReason: of a promise.
+ */
+- (void) cancelWithReason:(id)reason;
+
+
+/**
+ @brief Returns \c YES if the group has been cancelled.
+ */
+@property (nonatomic, readonly) BOOL isCancelled;
+
+
+/**
+ @brief The cancellation error if the group has been cancelled, otherwise \c nil.
+ */
+@property (nonatomic, readonly) NSError* cancellationReason;
+
+@end
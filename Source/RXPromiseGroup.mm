@@ -0,0 +1,254 @@
+//
+//  RXPromiseGroup.mm
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+
+#if (!__has_feature(objc_arc))
+#error this file requires arc enabled
+#endif
+
+#import "RXPromiseGroup.h"
+#import "RXPromise.h"
+#import "RXPromise+Private.h"
+#include "utility/pool.h"
+#include <atomic>
+
+
+namespace {
+
+    // A member of a group: either a promise, referenced weakly, or a
+    // cancellation handler.
+    struct member : rxpromise::pooled<member> {
+        member(RXPromise* p, void (^h)(NSError*)) : next(nullptr), promise(p), handler(h) {}
+
+        member*             next;
+        __weak RXPromise*   promise;
+        void (^handler)(NSError*);
+    };
+
+    // Marks the list of members as closed: the group has been cancelled.
+    inline member* closedMembers() {
+        return reinterpret_cast<member*>(uintptr_t(0x1));
+    }
+
+    constexpr std::size_t min_threshold = 32;
+
+    void cancelMember(member* m, NSError* error) {
+        if (m->handler) {
+            m->handler(error);
+        }
+        else if (RXPromise* promise = m->promise) {
+            [promise rxp_cancelIfPendingWithError:error];
+        }
+    }
+
+    // Cancels and destroys the members on the default concurrent queue, so
+    // that the cancelling thread neither walks the list nor executes the
+    // handlers of the members.
+    void cancelMembersAsync(member* m, NSError* error) {
+        if (m == nullptr) {
+            return;
+        }
+        dispatch_async(Shared.default_concurrent_queue, ^{
+            member* list = m;
+            while (list) {
+                member* next = list->next;
+                cancelMember(list, error);
+                delete list;
+                list = next;
+            }
+        });
+    }
+
+}
+
+
+// Implementation notes:
+//
+// The members form a lock-free list (LIFO). Adding a member pushes it with a
+// compare-and-swap. Cancelling exchanges the list with `closedMembers()`,
+// which marks the group as cancelled and takes all members in one atomic
+// operation; a member which will be pushed afterwards finds the list closed
+// and will be cancelled by the adding thread. The taken members will be
+// cancelled by one block on the default concurrent queue, so the cost of
+// `cancelWithReason:` does not depend on the number of members.
+//
+// The cancellation reason will be published before the list will be closed,
+// so a thread which observes the closed list also observes the reason.
+//
+// When the number of members added since the last compaction exceeds a
+// threshold, one thread takes the list, removes the members which have been
+// resolved or deallocated and pushes the remaining ones back. If the group has
+// been cancelled in the meantime, that thread cancels the remaining members.
+@implementation RXPromiseGroup {
+    std::atomic<member*>        _members;
+    std::atomic<void*>          _reason;        // a retained NSError
+    std::atomic<std::size_t>    _count;         // the approximate number of members
+    std::atomic<std::size_t>    _threshold;
+    std::atomic<bool>           _compacting;
+}
+
+
+- (instancetype) init {
+    self = [super init];
+    if (self) {
+        _members.store(nullptr, std::memory_order_relaxed);
+        _reason.store(nullptr, std::memory_order_relaxed);
+        _count.store(0, std::memory_order_relaxed);
+        _threshold.store(min_threshold, std::memory_order_relaxed);
+        _compacting.store(false, std::memory_order_relaxed);
+    }
+    return self;
+}
+
+
+- (void) dealloc {
+    member* m = _members.load(std::memory_order_acquire);
+    if (m != closedMembers()) {
+        while (m) {
+            member* next = m->next;
+            delete m;
+            m = next;
+        }
+    }
+    if (void* reason = _reason.load(std::memory_order_acquire)) {
+        (void)(__bridge_transfer NSError*)reason;
+    }
+}
+
+
+- (void) addPromise:(RXPromise*)promise {
+    if (promise == nil || !promise.isPending) {
+        return;
+    }
+    [self rxp_addMember:new member(promise, nil)];
+}
+
+
+- (void) addPromises:(NSArray*)promises {
+    for (RXPromise* promise in promises) {
+        [self addPromise:promise];
+    }
+}
+
+
+- (void) addCancellationHandler:(void(^)(NSError* reason))handler {
+    if (handler) {
+        [self rxp_addMember:new member(nil, [handler copy])];
+    }
+}
+
+
+- (void) cancel {
+    [self cancelWithReason:rxpromise::cancelled_error()];
+}
+
+
+- (void) cancelWithReason:(id)reason {
+    if (_reason.load(std::memory_order_acquire) != nullptr) {
+        return;
+    }
+    NSError* error = rxpromise::make_cancellation_error(reason);
+    void* retained = (__bridge_retained void*)error;
+    void* expected = nullptr;
+    if (!_reason.compare_exchange_strong(expected, retained, std::memory_order_acq_rel, std::memory_order_acquire)) {
+        // Another thread cancelled the group:
+        (void)(__bridge_transfer NSError*)retained;
+        return;
+    }
+    cancelMembersAsync(_members.exchange(closedMembers(), std::memory_order_acq_rel), error);
+}
+
+
+- (BOOL) isCancelled {
+    return _members.load(std::memory_order_acquire) == closedMembers();
+}
+
+
+- (NSError*) cancellationReason {
+    return (__bridge NSError*)_reason.load(std::memory_order_acquire);
+}
+
+
+#pragma mark - Private
+
+- (void) rxp_addMember:(member*)m {
+    member* head = _members.load(std::memory_order_acquire);
+    do {
+        if (head == closedMembers()) {
+            cancelMember(m, self.cancellationReason);
+            delete m;
+            return;
+        }
+        m->next = head;
+    } while (!_members.compare_exchange_weak(head, m, std::memory_order_release, std::memory_order_acquire));
+    if (_count.fetch_add(1, std::memory_order_relaxed) + 1 >= _threshold.load(std::memory_order_relaxed)) {
+        [self rxp_compact];
+    }
+}
+
+
+// Removes the members which have been resolved or deallocated.
+- (void) rxp_compact {
+    if (_compacting.exchange(true, std::memory_order_acquire)) {
+        return;
+    }
+    member* list = _members.load(std::memory_order_acquire);
+    do {
+        if (list == closedMembers()) {
+            _compacting.store(false, std::memory_order_release);
+            return;
+        }
+    } while (!_members.compare_exchange_weak(list, nullptr, std::memory_order_acq_rel, std::memory_order_acquire));
+
+    member* survivors = nullptr;
+    member* tail = nullptr;
+    std::size_t removed = 0;
+    std::size_t kept = 0;
+    while (list) {
+        member* next = list->next;
+        RXPromise* promise = list->promise;
+        if (list->handler || (promise && promise.isPending)) {
+            list->next = survivors;
+            survivors = list;
+            if (tail == nullptr) {
+                tail = list;
+            }
+            ++kept;
+        }
+        else {
+            delete list;
+            ++removed;
+        }
+        list = next;
+    }
+    _count.fetch_sub(removed, std::memory_order_relaxed);
+    _threshold.store(2 * kept > min_threshold ? 2 * kept : min_threshold, std::memory_order_relaxed);
+
+    if (survivors) {
+        member* head = _members.load(std::memory_order_acquire);
+        do {
+            if (head == closedMembers()) {
+                cancelMembersAsync(survivors, self.cancellationReason);
+                break;
+            }
+            tail->next = head;
+        } while (!_members.compare_exchange_weak(head, survivors, std::memory_order_release, std::memory_order_acquire));
+    }
+    _compacting.store(false, std::memory_order_release);
+}
+
+@end
@@ -48,6 +48,7 @@ typedef RXPromise* (^then_on_main_block_t)(promise_completionHandler_t, promise_
 @property (nonatomic, readonly) then_block_t then;
 @property (nonatomic, readonly) then_on_block_t thenOn;
 @property (nonatomic, readonly) then_on_main_block_t thenOnMain;
+@property (nonatomic, readonly) then_block_t thenInline;
  
 @property (nonatomic, readonly) RXPromise* parent;
 @property (nonatomic, readonly) RXPromise* root;
@@ -424,6 +425,41 @@ typedef RXPromise* (^catch_on_main_block_t)(promise_errorHandler_t);
  */
 @property (nonatomic, readonly) then_on_main_block_t thenOnMain;
 
+
+/*!
+ @brief Property \p thenInline returns a block whose signature is
+ @code
+ RXPromise* (^)(promise_completionHandler_t onSuccess, promise_errorHandler_t onError)
+ @endcode
+ 
+ When the block is called it will register the completion handler \p onSuccess and
+ the error handler \p onError. When the receiver will be resolved, the corresponding
+ handler will be executed synchronously on the thread which resolves the receiver.
+ This avoids the scheduling overhead of the other execution contexts and is intended
+ for cheap handlers, for example a handler which extracts a value from a dictionary.
+ 
+ @par The handlers must not block and must not take a long time to execute, since they
+ may delay the resolver and other handlers of the receiver.
+ 
+ @par When the block is invoked and the receiver is already resolved, the corresponding
+ handler will be executed synchronously on the current thread before the block returns.
+ 
+ @par When inline handlers of a chain of promises would be nested deeper than
+ \c RXPROMISE_INLINE_MAX_DEPTH (default 32) on the same thread, the handlers beyond
+ that depth will be executed on the same thread after the outermost inline handler
+ returned. When the receiver will be resolved on a private queue of the library, the
+ handler will be executed on the unspecified execution context.
+ 
+ @par The block returns a new \c RXPromise, the "returned promise", whose result will become
+ the return value of either handler that gets called when the receiver will be resolved.
+ 
+ @par Parameter \p onSuccess and \p onError may be \c nil.
+ 
+ @return Returns a block of type \c then_block_t.
+ */
+@property (nonatomic, readonly) then_block_t thenInline;
+
+
 /*!
  @brief Property \p catchOn returns a block whose signature is
  @code
@@ -514,6 +550,8 @@ typedef RXPromise* (^catch_on_main_block_t)(promise_errorHandler_t);
 /*!
  Cancels the promise unless it is already resolved and then forwards the
  message to all children.
+ 
+ @par See \p cancelWithReason: for when the cancellation takes effect.
  */
 - (void) cancel;
 
@@ -521,6 +559,14 @@ typedef RXPromise* (^catch_on_main_block_t)(promise_errorHandler_t);
  @brief Cancels the promise with the specfied reason unless it is already resolved and
  then forwards the message wto all children.
  
+ @discussion If the receiver is pending, it will be cancelled synchronously: when the
+ method returns, \p isCancelled returns \c YES, handlers registered with \p thenInline
+ have been executed on the calling thread, and handlers registered with \p then,
+ \p thenOn and \p thenOnMain have been dispatched to their execution contexts. Thus,
+ the caller should not hold a lock which an inline handler may acquire. If the
+ receiver has already been resolved, the cancellation will be forwarded to its
+ children asynchronously.
+ 
  @param reason The reason. If reason is not a \c NSError object, the receiver will
  create a \c NSError object whose demain is \@"RXPromise", the error code is -1000
  and the user dictionary contains an entry with key \c NSLocalizedFailureReason whose
@@ -0,0 +1,216 @@
+//
+//  RXStream.h
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+@class RXPromise;
+
+
+/* Synopsis
+
+ @interface RXStream : NSObject
+
+ + (instancetype) streamWithArray:(NSArray*)array;
+ + (instancetype) streamWithPromise:(RXPromise*)promise;
+
+ // Producer
+ - (void) sendValue:(id)value;
+ - (void) complete;
+ - (void) failWithReason:(id)reason;
+ - (void) setDemandHandler:(void(^)(NSUInteger n))handler;
+ - (void) setCancellationHandler:(void(^)(NSError* reason))handler;
+ @property (nonatomic, readonly) NSUInteger demand;
+ @property (nonatomic, readonly) BOOL isCancelled;
+
+ // Consumer
+ - (void) subscribeOn:(id)executionContext
+              onValue:(void(^)(id value))onValue
+         onCompletion:(void(^)(NSError* error))onCompletion;
+ - (void) request:(NSUInteger)n;
+ - (void) cancel;
+ - (void) cancelWithReason:(id)reason;
+
+ // Adapters
+ - (RXPromise*) toArray;
+ - (RXPromise*) first;
+
+ @end
+
+ */
+
+
+/**
+ @brief A stream delivers any number of values from a producer to one consumer,
+ followed by exactly one completion event.
+
+ @discussion The consumer subscribes with handlers which will be executed on an
+ execution context - a dispatch queue, a \c NSThread, a \c NSOperationQueue or
+ a \c NSManagedObjectContext, like the handlers of a promise. The value handler
+ will be invoked serially, in the order the values have been sent, also when
+ the execution context is a concurrent dispatch queue.
+
+ @par \b Backpressure: values will only be delivered as far as the consumer
+ requested them with \p request:. A producer should send only as many values as
+ have been requested; it gets notified about new demand through its demand handler.
+ Values sent beyond the demand will be buffered.
+
+ @par \b Completion: the completion handler will be invoked once, after all
+ buffered values have been delivered, with \c nil when the producer completed,
+ or with the error when the producer failed. When the consumer cancels the
+ stream, the buffered values will be discarded, the producer's cancellation
+ handler will be invoked and the completion handler will be invoked with the
+ cancellation error. The errors have the same form as the errors of a rejected
+ respectively cancelled \c RXPromise.
+
+ @par All methods are thread-safe.
+ */
+@interface RXStream : NSObject
+
+/**
+ @brief Returns a new stream which sends the elements of the array as requested,
+ and then completes.
+ */
++ (instancetype) streamWithArray:(NSArray*)array;
+
+
+/**
+ @brief Returns a new stream which sends the value of the promise and completes,
+ or fails with the error reason of the promise. Cancelling the stream cancels
+ the promise.
+ */
++ (instancetype) streamWithPromise:(RXPromise*)promise;
+
+
+#pragma mark - Producer
+
+/**
+ @brief Sends a value to the consumer. If the value is \c nil, \c NSNull will be
+ sent. Has no effect when the stream has been completed, failed or cancelled.
+ */
+- (void) sendValue:(id)value;
+
+
+/**
+ @brief Completes the stream. The consumer's completion handler will be invoked with
+ \c nil after all values sent before have been delivered.
+ */
+- (void) complete;
+
+
+/**
+ @brief Fails the stream. The consumer's completion handler will be invoked with the
+ error after all values sent before have been delivered.
+
+ @param reason A \c NSError, or an object which becomes the failure reason of an
+ error, like in \p rejectWithReason:.
+ */
+- (void) failWithReason:(id)reason;
+
+
+/**
+ @brief Sets the handler which will be invoked with the number of additionally
+ requested values each time the consumer requests values.
+
+ @discussion If values have already been requested, the handler will be invoked
+ immediately with the current demand. Invocations of the handler never overlap.
+ The handler may send values synchronously.
+ */
+- (void) setDemandHandler:(void(^)(NSUInteger n))handler;
+
+
+/**
+ @brief Sets the handler which will be invoked once when the consumer cancels the
+ stream. If the stream has already been cancelled, the handler will be invoked
+ immediately.
+ */
+- (void) setCancellationHandler:(void(^)(NSError* reason))handler;
+
+
+/**
+ @brief The number of values which have been requested and not yet been sent.
+ \c NSUIntegerMax means unbounded.
+ */
+@property (nonatomic, readonly) NSUInteger demand;
+
+
+/**
+ @brief Returns \c YES if the consumer cancelled the stream.
+ */
+@property (nonatomic, readonly) BOOL isCancelled;
+
+
+#pragma mark - Consumer
+
+/**
+ @brief Subscribes the consumer. A stream can be subscribed only once.
+
+ @discussion No values will be delivered until the consumer requests values with
+ \p request:.
+
+ @param executionContext The execution context of the handlers. If \c nil, the
+ handlers will be executed on the default concurrent queue of \c RXPromise, but
+ never concurrently.
+
+ @param onValue The handler which will be invoked for each value.
+
+ @param onCompletion The handler which will be invoked once after the last value,
+ with \c nil or an error.
+ */
+- (void) subscribeOn:(id)executionContext
+             onValue:(void(^)(id value))onValue
+        onCompletion:(void(^)(NSError* error))onCompletion;
+
+
+/**
+ @brief Requests \p n further values. Passing \c NSUIntegerMax requests all values.
+ */
+- (void) request:(NSUInteger)n;
+
+
+/**
+ @brief Cancels the stream with reason \c \@"cancelled".
+ */
+- (void) cancel;
+
+
+/**
+ @brief Cancels the stream. Has no effect when the completion has already been
+ delivered.
+ */
+- (void) cancelWithReason:(id)reason;
+
+
+#pragma mark - Adapters
+
+/**
+ @brief Subscribes to the stream, requests all values and returns a promise which
+ will be fulfilled with an array of all values when the stream completes, or
+ rejected with the error when the stream fails. Cancelling the returned promise
+ cancels the stream.
+ */
+- (RXPromise*) toArray;
+
+
+/**
+ @brief Subscribes to the stream, requests one value and returns a promise which
+ will be fulfilled with the first value. Then the stream will be cancelled. If the
+ stream completes without a value, the promise will be rejected with reason
+ \c \@"empty stream". Cancelling the returned promise cancels the stream.
+ */
+- (RXPromise*) first;
+
+@end
@@ -0,0 +1,406 @@
+//
+//  RXStream.mm
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+
+#if (!__has_feature(objc_arc))
+#error this file requires arc enabled
+#endif
+
+#import "RXStream.h"
+#import "RXPromise.h"
+#import "RXPromise+Private.h"
+#include <cassert>
+#include <deque>
+#include <mutex>
+
+
+// Implementation notes:
+//
+// All state is protected by `_mutex`, which will never be held while invoking
+// a handler. Values will be delivered by a "drain" block, which will be
+// dispatched to the consumer's execution context. There is at most one drain
+// block scheduled or running at any time, which serializes the invocations of
+// the consumer's handlers.
+@implementation RXStream {
+    std::mutex          _mutex;
+    std::deque<id>      _buffer;
+    NSUInteger          _demand;            // requested and not yet delivered
+    NSUInteger          _pendingDemand;     // requested and not yet passed to the demand handler
+    BOOL                _notifying;         // the demand handler is being invoked
+    BOOL                _subscribed;
+    BOOL                _draining;          // a drain block is scheduled or running
+    BOOL                _finished;          // completed, failed or cancelled
+    BOOL                _cancelled;
+    BOOL                _terminated;        // the completion has been delivered
+    NSError*            _error;
+    id                  _executionContext;
+    void (^_onValue)(id);
+    void (^_onCompletion)(NSError*);
+    void (^_demandHandler)(NSUInteger);
+    void (^_cancellationHandler)(NSError*);
+}
+
+
++ (instancetype) streamWithArray:(NSArray*)array {
+    RXStream* stream = [[self alloc] init];
+    NSArray* values = [array copy];
+    __block NSUInteger index = 0;
+    __weak RXStream* weakStream = stream;
+    // Invocations of the demand handler never overlap, thus `index` needs no
+    // further synchronization:
+    [stream setDemandHandler:^(NSUInteger n) {
+        RXStream* strongStream = weakStream;
+        NSUInteger count = [values count];
+        while (n > 0 && index < count && !strongStream.isCancelled) {
+            [strongStream sendValue:values[index]];
+            ++index;
+            --n;
+        }
+        if (index == count) {
+            [strongStream complete];
+        }
+    }];
+    if ([values count] == 0) {
+        [stream complete];
+    }
+    return stream;
+}
+
+
++ (instancetype) streamWithPromise:(RXPromise*)promise {
+    RXStream* stream = [[self alloc] init];
+    __weak RXPromise* weakPromise = promise;
+    [stream setCancellationHandler:^(NSError* reason) {
+        [weakPromise cancelWithReason:reason];
+    }];
+    [promise rxp_registerInlineOnSuccess:^id(id result) {
+        [stream sendValue:result];
+        [stream complete];
+        return nil;
+    } onFailure:^id(NSError* error) {
+        [stream failWithReason:error];
+        return nil;
+    }];
+    return stream;
+}
+
+
+#pragma mark - Producer
+
+- (void) sendValue:(id)value {
+    BOOL drain;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_finished) {
+            return;
+        }
+        _buffer.push_back(value ? value : [NSNull null]);
+        drain = [self locked_shouldDrain];
+    }
+    if (drain) {
+        [self rxp_scheduleDrain];
+    }
+}
+
+
+- (void) complete {
+    [self rxp_finishWithError:nil cancelled:NO];
+}
+
+
+- (void) failWithReason:(id)reason {
+    [self rxp_finishWithError:rxpromise::make_rejection_error(reason) cancelled:NO];
+}
+
+
+- (void) setDemandHandler:(void(^)(NSUInteger n))handler {
+    BOOL notify = NO;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _demandHandler = [handler copy];
+        // The values which have been requested and not yet been sent:
+        NSUInteger buffered = _buffer.size();
+        _pendingDemand = _demand == NSUIntegerMax ? NSUIntegerMax : (_demand > buffered ? _demand - buffered : 0);
+        if (_demandHandler && _pendingDemand > 0 && !_notifying && !_finished) {
+            _notifying = notify = YES;
+        }
+    }
+    if (notify) {
+        [self rxp_notifyDemand];
+    }
+}
+
+
+- (void) setCancellationHandler:(void(^)(NSError* reason))handler {
+    NSError* error = nil;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_cancelled) {
+            error = _error;
+        }
+        else {
+            _cancellationHandler = [handler copy];
+        }
+    }
+    if (error && handler) {
+        handler(error);
+    }
+}
+
+
+- (NSUInteger) demand {
+    std::lock_guard<std::mutex> lock(_mutex);
+    NSUInteger buffered = _buffer.size();
+    if (_demand == NSUIntegerMax) {
+        return NSUIntegerMax;
+    }
+    return _demand > buffered ? _demand - buffered : 0;
+}
+
+
+- (BOOL) isCancelled {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _cancelled;
+}
+
+
+#pragma mark - Consumer
+
+- (void) subscribeOn:(id)executionContext
+             onValue:(void(^)(id value))onValue
+        onCompletion:(void(^)(NSError* error))onCompletion
+{
+    BOOL drain;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        NSAssert(!_subscribed, @"a stream can be subscribed only once");
+        if (_subscribed) {
+            return;
+        }
+        _subscribed = YES;
+        _executionContext = executionContext;
+        _onValue = [onValue copy];
+        _onCompletion = [onCompletion copy];
+        drain = [self locked_shouldDrain];
+    }
+    if (drain) {
+        [self rxp_scheduleDrain];
+    }
+}
+
+
+- (void) request:(NSUInteger)n {
+    if (n == 0) {
+        return;
+    }
+    BOOL notify = NO;
+    BOOL drain;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_cancelled || _terminated) {
+            return;
+        }
+        // A finished stream may still have buffered values:
+        _demand = (n > NSUIntegerMax - _demand) ? NSUIntegerMax : _demand + n;
+        _pendingDemand = (n > NSUIntegerMax - _pendingDemand) ? NSUIntegerMax : _pendingDemand + n;
+        if (_demandHandler && !_notifying && !_finished) {
+            _notifying = notify = YES;
+        }
+        drain = [self locked_shouldDrain];
+    }
+    if (notify) {
+        [self rxp_notifyDemand];
+    }
+    if (drain) {
+        [self rxp_scheduleDrain];
+    }
+}
+
+
+- (void) cancel {
+    [self cancelWithReason:rxpromise::cancelled_error()];
+}
+
+
+- (void) cancelWithReason:(id)reason {
+    [self rxp_finishWithError:rxpromise::make_cancellation_error(reason) cancelled:YES];
+}
+
+
+#pragma mark - Adapters
+
+- (RXPromise*) toArray {
+    RXPromise* promise = [[RXPromise alloc] init];
+    NSMutableArray* values = [[NSMutableArray alloc] init];
+    // The value handler is never executed concurrently:
+    [self subscribeOn:nil onValue:^(id value) {
+        [values addObject:value];
+    } onCompletion:^(NSError* error) {
+        if (error) {
+            [promise rejectWithReason:error];
+        }
+        else {
+            [promise fulfillWithValue:[values copy]];
+        }
+    }];
+    __weak RXStream* weakSelf = self;
+    [promise rxp_registerInlineOnSuccess:nil onFailure:^id(NSError* error) {
+        [weakSelf cancelWithReason:error];
+        return nil;
+    }];
+    [self request:NSUIntegerMax];
+    return promise;
+}
+
+
+- (RXPromise*) first {
+    RXPromise* promise = [[RXPromise alloc] init];
+    __weak RXStream* weakSelf = self;
+    [self subscribeOn:nil onValue:^(id value) {
+        [promise fulfillWithValue:value];
+        [weakSelf cancel];
+    } onCompletion:^(NSError* error) {
+        // If the promise has already been fulfilled, this has no effect:
+        [promise rejectWithReason:error ? error : @"empty stream"];
+    }];
+    [promise rxp_registerInlineOnSuccess:nil onFailure:^id(NSError* error) {
+        [weakSelf cancelWithReason:error];
+        return nil;
+    }];
+    [self request:1];
+    return promise;
+}
+
+
+#pragma mark - Private
+
+// Requires the lock. Returns YES if the caller must schedule a drain block.
+- (BOOL) locked_shouldDrain {
+    if (!_subscribed || _draining || _terminated) {
+        return NO;
+    }
+    if ((!_buffer.empty() && _demand > 0) || (_finished && _buffer.empty())) {
+        _draining = YES;
+        return YES;
+    }
+    return NO;
+}
+
+
+- (void) rxp_scheduleDrain {
+    rxpromise::dispatch_to_execution_context(_executionContext, ^{
+        [self rxp_drain];
+    });
+}
+
+
+// Delivers the buffered values as far as they have been requested, and the
+// completion once the stream has been finished and the buffer is empty.
+- (void) rxp_drain {
+    for (;;) {
+        id value = nil;
+        NSError* error = nil;
+        void (^onCompletion)(NSError*) = nil;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_buffer.empty() && _demand > 0) {
+                value = _buffer.front();
+                _buffer.pop_front();
+                if (_demand != NSUIntegerMax) {
+                    --_demand;
+                }
+            }
+            else if (_finished && _buffer.empty()) {
+                _terminated = YES;
+                error = _error;
+                onCompletion = _onCompletion;
+                _onValue = nil;
+                _onCompletion = nil;
+            }
+            else {
+                _draining = NO;
+                return;
+            }
+        }
+        @autoreleasepool {
+            if (value) {
+                _onValue(value);
+            }
+            else {
+                if (onCompletion) {
+                    onCompletion(error);
+                }
+                return;
+            }
+        }
+    }
+}
+
+
+// Invokes the demand handler until there is no more pending demand. Requires
+// that the caller has set `_notifying`.
+- (void) rxp_notifyDemand {
+    for (;;) {
+        NSUInteger n;
+        void (^handler)(NSUInteger);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            n = _pendingDemand;
+            _pendingDemand = 0;
+            handler = _demandHandler;
+            if (n == 0 || handler == nil || _finished) {
+                _notifying = NO;
+                return;
+            }
+        }
+        handler(n);
+    }
+}
+
+
+- (void) rxp_finishWithError:(NSError*)error cancelled:(BOOL)cancelled {
+    void (^cancellationHandler)(NSError*) = nil;
+    BOOL drain;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_terminated || (_finished && !cancelled) || _cancelled) {
+            return;
+        }
+        if (cancelled) {
+            // Cancelling discards the buffered values, and overrides a
+            // completion which has not yet been delivered:
+            _buffer.clear();
+            _cancelled = YES;
+            if (!_finished) {
+                cancellationHandler = _cancellationHandler;
+            }
+        }
+        _finished = YES;
+        _error = error;
+        _cancellationHandler = nil;
+        _demandHandler = nil;
+        drain = [self locked_shouldDrain];
+    }
+    if (cancellationHandler) {
+        cancellationHandler(error);
+    }
+    if (drain) {
+        [self rxp_scheduleDrain];
+    }
+}
+
+@end
@@ -0,0 +1,165 @@
+//
+//  pool.h
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+
+#ifndef RXPROMISE_POOL_H
+#define RXPROMISE_POOL_H
+
+#include <pthread.h>
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+
+// RXPROMISE_POOLING
+// If not zero, small internal records, e.g. the continuations of a promise,
+// can be allocated from per thread free lists instead of the general purpose
+// allocator. Pooling is disabled by default and can be enabled at runtime with
+// `+[RXPromise setPoolingEnabled:]`; while disabled, each allocation costs one
+// additional load and branch. If zero, the free lists will be compiled out.
+// Each free list caches at most RXPROMISE_POOL_CAPACITY records.
+#if !defined (RXPROMISE_POOLING)
+#define RXPROMISE_POOLING 1
+#endif
+
+#if !defined (RXPROMISE_POOL_CAPACITY)
+#define RXPROMISE_POOL_CAPACITY 256
+#endif
+
+
+namespace rxpromise {
+
+    // Whether the pools are enabled. Namespace scope state without a guard for
+    // its initialization, like the state of the tracer.
+    template <typename T = void>
+    struct pooling {
+        static std::atomic<bool> enabled;
+    };
+
+    template <typename T> std::atomic<bool> pooling<T>::enabled(false);
+
+
+    // A per thread free list of memory blocks of `Size` bytes.
+    //
+    // A block may be deallocated on a different thread than it has been
+    // allocated; it will then be cached by the free list of the deallocating
+    // thread. When a free list is full, or pooling is disabled, blocks will be
+    // returned to the general purpose allocator. The free list of a thread will
+    // be released when the thread exits; blocks cached before pooling has been
+    // disabled remain cached until then.
+    template <std::size_t Size>
+    class pool {
+    public:
+        static void* allocate() {
+#if RXPROMISE_POOLING
+            if (!pooling<>::enabled.load(std::memory_order_relaxed)) {
+                return ::operator new(block_size);
+            }
+            if (free_list* list = current(true)) {
+                if (block* b = list->head) {
+                    list->head = b->next;
+                    --list->count;
+                    return b;
+                }
+            }
+#endif
+            return ::operator new(block_size);
+        }
+
+        static void deallocate(void* p) {
+#if RXPROMISE_POOLING
+            if (!pooling<>::enabled.load(std::memory_order_relaxed)) {
+                ::operator delete(p);
+                return;
+            }
+            free_list* list = current(false);
+            if (list && list->count < RXPROMISE_POOL_CAPACITY) {
+                block* b = static_cast<block*>(p);
+                b->next = list->head;
+                list->head = b;
+                ++list->count;
+                return;
+            }
+#endif
+            ::operator delete(p);
+        }
+
+    private:
+        struct block {
+            block* next;
+        };
+
+        static constexpr std::size_t block_size = Size < sizeof(block) ? sizeof(block) : Size;
+
+        struct free_list {
+            block*      head;
+            std::size_t count;
+        };
+
+        static pthread_key_t key() {
+            static pthread_key_t key = create_key();
+            return key;
+        }
+
+        static pthread_key_t create_key() {
+            pthread_key_t k;
+            pthread_key_create(&k, &destroy);
+            return k;
+        }
+
+        static void destroy(void* p) {
+            free_list* list = static_cast<free_list*>(p);
+            while (block* b = list->head) {
+                list->head = b->next;
+                ::operator delete(b);
+            }
+            delete list;
+        }
+
+        // Returns the free list of the current thread. If `create` is false and
+        // the thread has no free list, returns null.
+        static free_list* current(bool create) {
+            free_list* list = static_cast<free_list*>(pthread_getspecific(key()));
+            if (list == nullptr && create) {
+                list = new free_list{nullptr, 0};
+                pthread_setspecific(key(), list);
+            }
+            return list;
+        }
+    };
+
+
+    // Base class which allocates instances of a class `T` from a `pool`.
+    template <typename T>
+    struct pooled {
+        static void* operator new(std::size_t size) {
+            return size == sizeof(T) ? pool<sizeof(T)>::allocate() : ::operator new(size);
+        }
+
+        static void operator delete(void* p, std::size_t size) {
+            if (size == sizeof(T)) {
+                pool<sizeof(T)>::deallocate(p);
+            }
+            else {
+                ::operator delete(p);
+            }
+        }
+    };
+
+}
+
+#endif // RXPROMISE_POOL_H
@@ -0,0 +1,239 @@
+//
+//  statistics.h
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+
+#ifndef RXPROMISE_STATISTICS_H
+#define RXPROMISE_STATISTICS_H
+
+#include <pthread.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+
+// RXPROMISE_STATISTICS
+// If not zero, the library maintains counters and latency histograms of its
+// hot paths, which can be retrieved with `+[RXPromise statistics]`. Collecting
+// is enabled by default - counters are striped and latencies are sampled, so
+// that it is cheap enough for production - and can be switched off at runtime
+// with `+[RXPromise setStatisticsEnabled:]`. While disabled, each probe costs
+// one load and one branch. If zero, the probes will be compiled out entirely.
+// The benchmarks `chain_then_statistics_enabled` and `_disabled` compare both
+// modes.
+#if !defined (RXPROMISE_STATISTICS)
+#define RXPROMISE_STATISTICS 1
+#endif
+
+// RXPROMISE_STATISTICS_STRIPES
+// The number of cache line aligned copies of the counters. A thread updates
+// the copy selected by its identity, which keeps threads from contending on
+// the same cache line.
+#if !defined (RXPROMISE_STATISTICS_STRIPES)
+#define RXPROMISE_STATISTICS_STRIPES 16
+#endif
+
+static_assert(RXPROMISE_STATISTICS_STRIPES > 0, "RXPROMISE_STATISTICS_STRIPES must be greater than zero");
+
+// RXPROMISE_STATISTICS_SAMPLE_PERIOD
+// The latency histograms record one of this many events per stripe, since
+// measuring a latency takes two clock reads. The counters count every event.
+// Must be a power of two.
+#if !defined (RXPROMISE_STATISTICS_SAMPLE_PERIOD)
+#define RXPROMISE_STATISTICS_SAMPLE_PERIOD 64
+#endif
+
+static_assert(RXPROMISE_STATISTICS_SAMPLE_PERIOD > 0 && (RXPROMISE_STATISTICS_SAMPLE_PERIOD & (RXPROMISE_STATISTICS_SAMPLE_PERIOD - 1)) == 0,
+              "RXPROMISE_STATISTICS_SAMPLE_PERIOD must be a power of two");
+
+
+namespace rxpromise {
+
+    // A histogram of durations in nanoseconds with logarithmic buckets: bucket
+    // 0 counts durations below 1 ns, and bucket `i` counts the durations in
+    // [2^(i-1), 2^i) ns. The last bucket counts all longer durations.
+    class histogram {
+    public:
+        static constexpr unsigned bucket_count = 40;   // the last bucket starts at ~275 s
+
+        // Zero-initialized when it has static storage duration.
+        histogram() = default;
+
+        histogram(histogram const&) = delete;
+        histogram& operator=(histogram const&) = delete;
+
+        void record(uint64_t ns) {
+            buckets_[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        uint64_t bucket(unsigned i) const {
+            return buckets_[i].load(std::memory_order_relaxed);
+        }
+
+        // The upper bound of bucket `i` in nanoseconds (exclusive).
+        static uint64_t upper_bound(unsigned i) {
+            return uint64_t(1) << i;
+        }
+
+        void reset() {
+            for (unsigned i = 0; i < bucket_count; ++i) {
+                buckets_[i].store(0, std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        static unsigned bucket_index(uint64_t ns) {
+            unsigned i = 0;
+            while (ns != 0 && i < bucket_count - 1) {
+                ns >>= 1;
+                ++i;
+            }
+            return i;
+        }
+
+        std::atomic<uint64_t> buckets_[bucket_count];
+    };
+
+
+    // Counters and latency histograms of the promise library.
+    //
+    // All probes use relaxed atomic operations. A snapshot of the counters is
+    // not taken atomically, so counters may be slightly inconsistent with each
+    // other while promises are being processed.
+    //
+    // The shared instance has static storage duration and a trivial default
+    // constructor, so it is zero-initialized - and enabled - before any code
+    // runs, and accessing it requires no initialization guard.
+    class statistics {
+    public:
+        enum counter {
+            created,
+            fulfilled,
+            rejected,
+            cancelled,
+            deallocated,
+            dispatch_concurrent,    // handlers registered with `then`
+            dispatch_inline,        // handlers registered with `thenInline`
+            dispatch_queue,         // handlers dispatched to a dispatch queue
+            dispatch_other,         // handlers dispatched to a NSThread, NSOperationQueue, etc.
+            counter_count
+        };
+
+        statistics() = default;
+
+        statistics(statistics const&) = delete;
+        statistics& operator=(statistics const&) = delete;
+
+        static statistics& shared() {
+            return instance<>::stats;
+        }
+
+        bool enabled() const {
+            return !disabled_.load(std::memory_order_relaxed);
+        }
+
+        void set_enabled(bool enabled) {
+            disabled_.store(!enabled, std::memory_order_relaxed);
+        }
+
+        void count(counter c) {
+            stripes_[stripe_index()].values[c].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Returns true for one of `RXPROMISE_STATISTICS_SAMPLE_PERIOD` calls
+        // on the same stripe, including the first one after `reset`.
+        bool sample() {
+            return (stripes_[stripe_index()].samples.fetch_add(1, std::memory_order_relaxed) & (sample_period - 1)) == 0;
+        }
+
+        uint64_t value(counter c) const {
+            uint64_t sum = 0;
+            for (std::size_t i = 0; i < stripe_count; ++i) {
+                sum += stripes_[i].values[c].load(std::memory_order_relaxed);
+            }
+            return sum;
+        }
+
+        void reset() {
+            for (std::size_t i = 0; i < stripe_count; ++i) {
+                for (unsigned c = 0; c < counter_count; ++c) {
+                    stripes_[i].values[c].store(0, std::memory_order_relaxed);
+                }
+                stripes_[i].samples.store(0, std::memory_order_relaxed);
+            }
+            handler_latency.reset();
+            sync_queue_wait.reset();
+        }
+
+        // A monotonic timestamp in nanoseconds.
+        static uint64_t now() {
+            return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        // The time from resolving a promise - or registering a handler on an
+        // already resolved promise - until its handler starts executing.
+        // Sampled.
+        histogram handler_latency;
+
+        // The time a block submitted to a sync queue waits until it starts
+        // executing. Sampled.
+        histogram sync_queue_wait;
+
+    private:
+        static constexpr std::size_t stripe_count = RXPROMISE_STATISTICS_STRIPES;
+        static constexpr uint64_t sample_period = RXPROMISE_STATISTICS_SAMPLE_PERIOD;
+
+        struct alignas(64) stripe {
+            std::atomic<uint64_t> values[counter_count];
+            std::atomic<uint64_t> samples;
+        };
+
+        // Namespace scope state without a guard for its initialization.
+        template <typename T = void>
+        struct instance {
+            static statistics stats;
+        };
+
+        static std::size_t stripe_index() {
+            std::uintptr_t h = reinterpret_cast<std::uintptr_t>(pthread_self());
+            h ^= h >> 12;
+            return (h >> 4) % stripe_count;
+        }
+
+        std::atomic<bool>   disabled_;      // zero-initialized: enabled
+        stripe              stripes_[stripe_count];
+    };
+
+    template <typename T> statistics statistics::instance<T>::stats;
+
+}
+
+
+#if RXPROMISE_STATISTICS
+#define RXP_STATS_ENABLED() (rxpromise::statistics::shared().enabled())
+#define RXP_STATS_COUNT(c) do { if (RXP_STATS_ENABLED()) { rxpromise::statistics::shared().count(rxpromise::statistics::c); } } while (0)
+#define RXP_STATS_SAMPLE() ((RXP_STATS_ENABLED() && rxpromise::statistics::shared().sample()) ? rxpromise::statistics::now() : 0)
+#define RXP_STATS_RECORD(histogram, start) do { if ((start) != 0) { rxpromise::statistics::shared().histogram.record(rxpromise::statistics::now() - (start)); } } while (0)
+#else
+#define RXP_STATS_ENABLED() (false)
+#define RXP_STATS_COUNT(c) do {} while (0)
+#define RXP_STATS_SAMPLE() (uint64_t(0))
+#define RXP_STATS_RECORD(histogram, start) do { (void)(start); } while (0)
+#endif
+
+
+#endif // RXPROMISE_STATISTICS_H
@@ -0,0 +1,197 @@
+//
+//  timer_service.h
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+
+#ifndef RXPROMISE_TIMER_SERVICE_H
+#define RXPROMISE_TIMER_SERVICE_H
+
+#include "timer_wheel.h"
+#include "pool.h"
+#include <dispatch/dispatch.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <cstdint>
+
+
+// RXPROMISE_TIMER_TICK
+// The granularity of one-shot timers in nanoseconds, for example the timers
+// of `setTimeout:`. A timer fires no earlier than its deadline, and at the
+// latest one tick plus the leeway after its deadline.
+#if !defined (RXPROMISE_TIMER_TICK)
+#define RXPROMISE_TIMER_TICK 1000000ull // 1 ms
+#endif
+
+// RXPROMISE_TIMER_LEEWAY
+// The leeway in nanoseconds of the dispatch timer which drives the timers.
+#if !defined (RXPROMISE_TIMER_LEEWAY)
+#define RXPROMISE_TIMER_LEEWAY RXPROMISE_TIMER_TICK
+#endif
+
+static_assert(RXPROMISE_TIMER_TICK > 0, "RXPROMISE_TIMER_TICK must be greater than zero");
+
+
+namespace rxpromise {
+
+    // Manages any number of one-shot timers with one hierarchical timer wheel,
+    // driven by one dispatch timer source. The dispatch timer is a one-shot
+    // timer, too: it will be armed for the next tick at which a timer of the
+    // wheel may expire, so a single timer wakes up the queue about once, not
+    // once per tick. While there are no scheduled timers, it is not armed.
+    //
+    // Scheduling and cancelling a timer is O(1) and may be invoked from any
+    // thread. The blocks of the timers will be invoked on a private serial
+    // queue, and must not take a long time to execute.
+    class timer_service {
+    public:
+        // A timer is referenced by the timer service until it fires or it has
+        // been cancelled, and by the client until it invokes `cancel`.
+        struct timer : timer_wheel::node, pooled<timer> {
+            dispatch_block_t    block;
+            std::atomic<int>    refs;
+        };
+
+        timer_service(uint64_t tick, uint64_t leeway)
+        :   tick_(tick), leeway_(leeway),
+            epoch_(std::chrono::steady_clock::now()),
+            queue_(dispatch_queue_create("RXPromise.timer_queue", NULL)),
+            source_(dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue_)),
+            armed_(not_armed)
+        {
+            assert(queue_ && source_);
+            timer_service* service = this;
+            dispatch_source_set_event_handler(source_, ^{
+                service->fire();
+            });
+            dispatch_source_set_timer(source_, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, leeway_);
+            dispatch_resume(source_);
+        }
+
+        timer_service(timer_service const&) = delete;
+        timer_service& operator=(timer_service const&) = delete;
+
+        // The shared timer service. It will never be destroyed, since timers
+        // may still fire while the process exits.
+        static timer_service& shared() {
+            static timer_service* service = new timer_service(RXPROMISE_TIMER_TICK, RXPROMISE_TIMER_LEEWAY);
+            return *service;
+        }
+
+        // Schedules a timer which invokes `block` once after `delay` nanoseconds.
+        // The client must invoke `cancel` with the returned timer exactly once,
+        // regardless of whether it fired or not.
+        timer* schedule(uint64_t delay, dispatch_block_t block) {
+            timer* t = new timer();
+            t->block = block;
+            t->refs.store(2, std::memory_order_relaxed);
+            uint64_t now = elapsed();
+            uint64_t deadline = (now + delay + tick_ - 1) / tick_;
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (wheel_.empty()) {
+                // Move the wheel over the idle period in one step, instead of
+                // letting the next `fire` walk through it:
+                wheel_.advance(now / tick_, [](timer_wheel::node*) {});
+            }
+            wheel_.schedule(t, deadline);
+            if (t->deadline < armed_) {
+                locked_arm(t->deadline);
+            }
+            return t;
+        }
+
+        // Cancels the timer if it has not yet fired, and releases the client's
+        // reference. Returns true if the timer has been cancelled before it fired.
+        bool cancel(timer* t) {
+            bool cancelled;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                cancelled = wheel_.cancel(t);
+            }
+            if (cancelled) {
+                release(t);
+            }
+            release(t);
+            return cancelled;
+        }
+
+    private:
+        uint64_t elapsed() const {
+            return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch_).count();
+        }
+
+        // Arms the dispatch timer for tick `tick`, or disarms it if `tick` is
+        // `not_armed`. Requires the lock.
+        void locked_arm(uint64_t tick) {
+            armed_ = tick;
+            if (tick == not_armed) {
+                dispatch_source_set_timer(source_, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, leeway_);
+                return;
+            }
+            uint64_t at = tick * tick_;
+            uint64_t now = elapsed();
+            dispatch_source_set_timer(source_, dispatch_time(DISPATCH_TIME_NOW, at > now ? (int64_t)(at - now) : 0),
+                                      DISPATCH_TIME_FOREVER, leeway_);
+        }
+
+        static void release(timer* t) {
+            if (t->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete t;
+            }
+        }
+
+        // Invoked on the private queue by the dispatch timer source.
+        void fire() {
+            // Collect the expired timers in the order they expired, and invoke
+            // their blocks without holding the lock:
+            timer_wheel::node* expired = nullptr;
+            timer_wheel::node** tail = &expired;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                wheel_.advance(elapsed() / tick_, [&tail](timer_wheel::node* n) {
+                    *tail = n;
+                    tail = &n->next;
+                });
+                if (wheel_.empty()) {
+                    locked_arm(not_armed);
+                }
+                else {
+                    locked_arm(wheel_.next_event());
+                }
+            }
+            while (expired) {
+                timer* t = static_cast<timer*>(expired);
+                expired = expired->next;
+                t->next = nullptr;
+                t->block();
+                release(t);
+            }
+        }
+
+        uint64_t            tick_;
+        uint64_t            leeway_;
+        std::chrono::steady_clock::time_point epoch_;
+        dispatch_queue_t    queue_;
+        dispatch_source_t   source_;
+        std::mutex          mutex_;
+        timer_wheel         wheel_;
+        uint64_t            armed_;     // the tick the dispatch timer has been armed for
+        static constexpr uint64_t not_armed = UINT64_MAX;
+    };
+
+}
+
+#endif // RXPROMISE_TIMER_SERVICE_H
@@ -0,0 +1,221 @@
+//
+//  timer_wheel.h
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+
+#ifndef RXPROMISE_TIMER_WHEEL_H
+#define RXPROMISE_TIMER_WHEEL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+
+
+namespace rxpromise {
+
+    // A hierarchical timer wheel.
+    //
+    // Time is measured in "ticks". Level 0 has one slot per tick, and each
+    // following level has one slot per full rotation of its lower level. A
+    // timer will be put into the lowest level whose range covers its deadline,
+    // and moved down to lower levels ("cascaded") as the time advances. Timers
+    // whose deadline is beyond the range of the highest level will be put into
+    // the last slot of the highest level and will be re-inserted when that slot
+    // will be cascaded.
+    //
+    // Scheduling and cancelling a timer is O(1). Advancing the time skips the
+    // ticks at which no timer expires and no slot will be cascaded, so its cost
+    // depends on the number of expired and cascaded timers rather than on the
+    // elapsed time.
+    //
+    // Timers are intrusive: a client derives from `timer_wheel::node` and owns
+    // the node. A timer_wheel is not thread-safe.
+    class timer_wheel {
+    public:
+        static constexpr unsigned slot_bits = 6;
+        static constexpr unsigned slot_count = 1u << slot_bits;
+        static constexpr unsigned level_count = 4;
+
+        struct node {
+            node() : next(nullptr), pprev(nullptr), deadline(0) {}
+
+            bool is_scheduled() const { return pprev != nullptr; }
+
+            node*       next;
+            node**      pprev;
+            uint64_t    deadline;
+        };
+
+        explicit timer_wheel(uint64_t now = 0) : now_(now), count_(0) {
+            for (unsigned l = 0; l < level_count; ++l) {
+                for (unsigned s = 0; s < slot_count; ++s) {
+                    slots_[l][s] = nullptr;
+                }
+            }
+        }
+
+        timer_wheel(timer_wheel const&) = delete;
+        timer_wheel& operator=(timer_wheel const&) = delete;
+
+        // The current tick.
+        uint64_t now() const { return now_; }
+
+        // The number of scheduled timers.
+        std::size_t size() const { return count_; }
+
+        bool empty() const { return count_ == 0; }
+
+        // Schedules the timer to expire at tick `deadline`. A deadline which
+        // is not in the future will expire with the next tick.
+        void schedule(node* n, uint64_t deadline) {
+            assert(!n->is_scheduled());
+            n->deadline = deadline > now_ ? deadline : now_ + 1;
+            place(n);
+            ++count_;
+        }
+
+        // Removes the timer. Returns false if the timer is not scheduled,
+        // that is, it has already expired or has been cancelled.
+        bool cancel(node* n) {
+            if (!n->is_scheduled()) {
+                return false;
+            }
+            unlink(n);
+            --count_;
+            return true;
+        }
+
+        // Returns the next tick at which a timer may expire or a slot will be
+        // cascaded, which is a tick after `now()`. The first timer expires no
+        // earlier than this tick. Requires that the wheel is not empty.
+        uint64_t next_event() const {
+            assert(count_ != 0);
+            uint64_t next = UINT64_MAX;
+            for (uint64_t i = 1; i <= slot_count; ++i) {
+                if (slots_[0][(now_ + i) & slot_mask]) {
+                    next = now_ + i;
+                    break;
+                }
+            }
+            for (unsigned level = 1; level < level_count; ++level) {
+                unsigned shift = slot_bits * level;
+                uint64_t rotation = now_ >> shift;
+                if (((rotation + 1) << shift) >= next) {
+                    break;  // the slots of this and higher levels begin later
+                }
+                for (uint64_t i = 1; i <= slot_count; ++i) {
+                    if (slots_[level][(rotation + i) & slot_mask]) {
+                        uint64_t begin = (rotation + i) << shift;
+                        next = begin < next ? begin : next;
+                        break;
+                    }
+                }
+            }
+            return next;
+        }
+
+        // Advances the time to tick `target` and invokes `f(node*)` for each
+        // expired timer. The timer is no longer scheduled when `f` is invoked.
+        template <typename F>
+        void advance(uint64_t target, F f) {
+            while (now_ < target) {
+                uint64_t next = count_ == 0 ? UINT64_MAX : next_event();
+                if (next > target) {
+                    now_ = target;
+                    break;
+                }
+                now_ = next;
+                cascade();
+                node*& slot = slots_[0][now_ & (slot_count - 1)];
+                while (node* n = slot) {
+                    assert(n->deadline == now_);
+                    unlink(n);
+                    --count_;
+                    f(n);
+                }
+            }
+        }
+
+    private:
+        static constexpr uint64_t slot_mask = slot_count - 1;
+
+        // Inserts the timer into the slot corresponding to its deadline.
+        // Requires `deadline >= now_`.
+        void place(node* n) {
+            assert(n->deadline >= now_);
+            uint64_t delta = n->deadline - now_;
+            unsigned level = 0;
+            while (level < level_count - 1 && delta >= (uint64_t(1) << (slot_bits * (level + 1)))) {
+                ++level;
+            }
+            unsigned index;
+            if (delta >= (uint64_t(1) << (slot_bits * level_count))) {
+                // Beyond the range of the wheel: put the timer into the last
+                // slot of the highest level.
+                index = static_cast<unsigned>(((now_ >> (slot_bits * level)) - 1) & slot_mask);
+            }
+            else {
+                index = static_cast<unsigned>((n->deadline >> (slot_bits * level)) & slot_mask);
+            }
+            link(n, &slots_[level][index]);
+        }
+
+        // Moves the timers of the higher level slots which begin at the
+        // current tick to lower levels.
+        void cascade() {
+            for (unsigned level = 1; level < level_count; ++level) {
+                if (((now_ >> (slot_bits * (level - 1))) & slot_mask) != 0) {
+                    break;
+                }
+                node*& slot = slots_[level][(now_ >> (slot_bits * level)) & slot_mask];
+                node* n = slot;
+                slot = nullptr;
+                while (n) {
+                    node* next = n->next;
+                    n->next = nullptr;
+                    n->pprev = nullptr;
+                    place(n);
+                    n = next;
+                }
+            }
+        }
+
+        static void link(node* n, node** head) {
+            n->next = *head;
+            if (n->next) {
+                n->next->pprev = &n->next;
+            }
+            n->pprev = head;
+            *head = n;
+        }
+
+        static void unlink(node* n) {
+            *n->pprev = n->next;
+            if (n->next) {
+                n->next->pprev = n->pprev;
+            }
+            n->next = nullptr;
+            n->pprev = nullptr;
+        }
+
+        uint64_t        now_;
+        std::size_t     count_;
+        node*           slots_[level_count][slot_count];
+    };
+
+}
+
+#endif // RXPROMISE_TIMER_WHEEL_H
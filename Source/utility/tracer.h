@@ -0,0 +1,263 @@
+//
+//  tracer.h
+//
+//  Copyright 2013 Andreas Grosam
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+
+#ifndef RXPROMISE_TRACER_H
+#define RXPROMISE_TRACER_H
+
+#include <pthread.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+
+// RXPROMISE_TRACING
+// If not zero, the life cycle events of promises can be recorded at runtime
+// with `+[RXPromise setTracingEnabled:]`. Tracing is disabled by default, in
+// which case each probe costs one load and one branch. If zero, the probes
+// will be compiled out entirely.
+#if !defined (RXPROMISE_TRACING)
+#define RXPROMISE_TRACING 1
+#endif
+
+// RXPROMISE_TRACE_BUFFER_SIZE
+// The number of events each thread keeps in its ring buffer. When the buffer
+// is full, the oldest events will be overwritten. Must be a power of two.
+#if !defined (RXPROMISE_TRACE_BUFFER_SIZE)
+#define RXPROMISE_TRACE_BUFFER_SIZE 4096
+#endif
+
+static_assert(RXPROMISE_TRACE_BUFFER_SIZE > 0 && (RXPROMISE_TRACE_BUFFER_SIZE & (RXPROMISE_TRACE_BUFFER_SIZE - 1)) == 0,
+              "RXPROMISE_TRACE_BUFFER_SIZE must be a power of two");
+
+
+namespace rxpromise {
+
+    // Records life cycle events of promises into per thread ring buffers.
+    //
+    // Each thread only writes to its own buffer, which requires no locks and
+    // no read-modify-write operations. A reader may collect the events of all
+    // buffers at any time; events which have been overwritten while they have
+    // been read will be dropped.
+    //
+    // The buffer of a thread which exited will be reused by a new thread, so
+    // the number of buffers is bounded by the maximum number of threads which
+    // recorded events at the same time. Buffers will never be deallocated.
+    class tracer {
+    public:
+        enum event_type : uint8_t {
+            created,            // related: none
+            registered,         // a handler has been registered; related: the returned promise
+            resolved,           // arg: the state
+            handler_begin,      // related: the returned promise
+            handler_end,        // related: the returned promise
+            cancel_requested,
+        };
+
+        struct event {
+            uint64_t        timestamp;  // nanoseconds, see `now()`
+            uint64_t        thread;     // a small number identifying the thread
+            std::uintptr_t  promise;
+            std::uintptr_t  parent;
+            std::uintptr_t  related;
+            event_type      type;
+            uint8_t         arg;
+        };
+
+        static constexpr std::size_t capacity = RXPROMISE_TRACE_BUFFER_SIZE;
+
+        static bool enabled() {
+            return __builtin_expect(state<>::enabled.load(std::memory_order_relaxed), false);
+        }
+
+        static void set_enabled(bool enabled) {
+            state<>::enabled.store(enabled, std::memory_order_relaxed);
+        }
+
+        // A monotonic timestamp in nanoseconds.
+        static uint64_t now() {
+            return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        // Records an event into the buffer of the current thread.
+        static void record(event_type type, void const* promise, void const* parent, void const* related = nullptr, uint8_t arg = 0) {
+            buffer* b = buffer::current();
+            if (b == nullptr) {
+                return;
+            }
+            uint64_t h = b->head.load(std::memory_order_relaxed);
+            // Announce that the slot will be overwritten before writing it:
+            b->claimed.store(h + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot& s = b->slots[h & (capacity - 1)];
+            s.timestamp.store(now(), std::memory_order_relaxed);
+            s.thread.store(b->thread, std::memory_order_relaxed);
+            s.promise.store(reinterpret_cast<std::uintptr_t>(promise), std::memory_order_relaxed);
+            s.parent.store(reinterpret_cast<std::uintptr_t>(parent), std::memory_order_relaxed);
+            s.related.store(reinterpret_cast<std::uintptr_t>(related), std::memory_order_relaxed);
+            s.type_and_arg.store(uint16_t(type) | uint16_t(arg) << 8, std::memory_order_relaxed);
+            b->head.store(h + 1, std::memory_order_release);
+        }
+
+        // Invokes `f(event const&)` for each recorded event which has not been
+        // cleared. The events of one thread will be visited in the order they
+        // have been recorded. May be invoked from any thread.
+        template <typename F>
+        static void for_each(F f) {
+            for (buffer* b = state<>::buffers.load(std::memory_order_acquire); b; b = b->next) {
+                uint64_t head = b->head.load(std::memory_order_acquire);
+                uint64_t begin = head > capacity ? head - capacity : 0;
+                uint64_t cleared = b->cleared.load(std::memory_order_relaxed);
+                if (cleared > begin) {
+                    begin = cleared;
+                }
+                if (begin >= head) {
+                    continue;
+                }
+                std::vector<event> events(head - begin);
+                for (uint64_t i = begin; i < head; ++i) {
+                    slot const& s = b->slots[i & (capacity - 1)];
+                    event& e = events[i - begin];
+                    e.timestamp = s.timestamp.load(std::memory_order_relaxed);
+                    e.thread = s.thread.load(std::memory_order_relaxed);
+                    e.promise = s.promise.load(std::memory_order_relaxed);
+                    e.parent = s.parent.load(std::memory_order_relaxed);
+                    e.related = s.related.load(std::memory_order_relaxed);
+                    uint16_t type_and_arg = s.type_and_arg.load(std::memory_order_relaxed);
+                    e.type = event_type(type_and_arg & 0xff);
+                    e.arg = uint8_t(type_and_arg >> 8);
+                }
+                // Drop the events whose slots may have been overwritten by the
+                // owning thread while they have been read:
+                std::atomic_thread_fence(std::memory_order_acquire);
+                uint64_t claimed = b->claimed.load(std::memory_order_relaxed);
+                for (uint64_t i = begin; i < head; ++i) {
+                    if (i + capacity >= claimed) {
+                        f(events[i - begin]);
+                    }
+                }
+            }
+        }
+
+        // Discards all events recorded so far. May be invoked from any thread.
+        static void clear() {
+            for (buffer* b = state<>::buffers.load(std::memory_order_acquire); b; b = b->next) {
+                b->cleared.store(b->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        struct slot {
+            std::atomic<uint64_t>       timestamp;
+            std::atomic<uint64_t>       thread;
+            std::atomic<std::uintptr_t> promise;
+            std::atomic<std::uintptr_t> parent;
+            std::atomic<std::uintptr_t> related;
+            std::atomic<uint16_t>       type_and_arg;
+        };
+
+        struct buffer {
+            buffer() : next(nullptr), thread(0), in_use(true), head(0), claimed(0), cleared(0) {}
+
+            // Returns the buffer of the current thread, which will be assigned
+            // on first use. Returns null if the buffer cannot be allocated.
+            static buffer* current() {
+                buffer* b = static_cast<buffer*>(pthread_getspecific(key()));
+                if (b == nullptr) {
+                    b = acquire();
+                    if (b) {
+                        pthread_setspecific(key(), b);
+                    }
+                }
+                return b;
+            }
+
+            // Reuses the buffer of an exited thread, or creates a new one.
+            static buffer* acquire() {
+                buffer* b = state<>::buffers.load(std::memory_order_acquire);
+                for (; b; b = b->next) {
+                    bool expected = false;
+                    if (!b->in_use.load(std::memory_order_relaxed)
+                        && b->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire, std::memory_order_relaxed)) {
+                        break;
+                    }
+                }
+                if (b == nullptr) {
+                    b = new (std::nothrow) buffer();
+                    if (b == nullptr) {
+                        return nullptr;
+                    }
+                    buffer* head = state<>::buffers.load(std::memory_order_relaxed);
+                    do {
+                        b->next = head;
+                    } while (!state<>::buffers.compare_exchange_weak(head, b, std::memory_order_release, std::memory_order_relaxed));
+                }
+                b->thread = state<>::thread_count.fetch_add(1, std::memory_order_relaxed) + 1;
+                return b;
+            }
+
+            static void release(void* p) {
+                static_cast<buffer*>(p)->in_use.store(false, std::memory_order_release);
+            }
+
+            static pthread_key_t key() {
+                static pthread_key_t key = create_key();
+                return key;
+            }
+
+            static pthread_key_t create_key() {
+                pthread_key_t k;
+                pthread_key_create(&k, &release);
+                return k;
+            }
+
+            buffer*                 next;       // immutable once published
+            uint64_t                thread;
+            std::atomic<bool>       in_use;
+            std::atomic<uint64_t>   head;       // the number of recorded events
+            std::atomic<uint64_t>   claimed;    // the number of events whose slot is being or has been written
+            std::atomic<uint64_t>   cleared;    // the number of events discarded by `clear`
+            slot                    slots[capacity];
+        };
+
+        // Namespace scope state without a guard for its initialization.
+        template <typename T = void>
+        struct state {
+            static std::atomic<bool>        enabled;
+            static std::atomic<buffer*>     buffers;
+            static std::atomic<uint64_t>    thread_count;
+        };
+    };
+
+    template <typename T> std::atomic<bool> tracer::state<T>::enabled(false);
+    template <typename T> std::atomic<tracer::buffer*> tracer::state<T>::buffers(nullptr);
+    template <typename T> std::atomic<uint64_t> tracer::state<T>::thread_count(0);
+
+}
+
+
+#if RXPROMISE_TRACING
+#define RXP_TRACE(...) do { if (rxpromise::tracer::enabled()) { rxpromise::tracer::record(__VA_ARGS__); } } while (0)
+#else
+#define RXP_TRACE(...) do {} while (0)
+#endif
+
+
+#endif // RXPROMISE_TRACER_H
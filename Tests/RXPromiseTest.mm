@@ -791,6 +791,57 @@ static RXPromise* asyncOp(NSString* label, int workCount, NSOperationQueue* queu
 }
 
 
+-(void) testStateShouldBeSettledWhenResolverReturns
+{
+    RXPromise* promise1 = [[RXPromise alloc] init];
+    [promise1 fulfillWithValue:@"OK"];
+    XCTAssertTrue(promise1.isFulfilled == YES, @"");
+    XCTAssertTrue([promise1.get isEqualToString:@"OK"], @"");
+
+    RXPromise* promise2 = [[RXPromise alloc] init];
+    [promise2 rejectWithReason:@"Fail"];
+    XCTAssertTrue(promise2.isRejected == YES, @"");
+    XCTAssertTrue(promise2.isCancelled == NO, @"");
+
+    RXPromise* promise3 = [[RXPromise alloc] init];
+    [promise3 cancel];
+    XCTAssertTrue(promise3.isCancelled == YES, @"");
+}
+
+
+-(void) testConcurrentResolversShouldResolveOnlyOnce
+{
+    const size_t N = 1000;
+    NSMutableArray* promises = [[NSMutableArray alloc] initWithCapacity:N];
+    for (size_t i = 0; i < N; ++i) {
+        [promises addObject:[[RXPromise alloc] init]];
+    }
+    dispatch_apply(8, dispatch_get_global_queue(0, 0), ^(size_t t) {
+        for (RXPromise* promise in promises) {
+            switch (t % 3) {
+                case 0: [promise fulfillWithValue:@(t)]; break;
+                case 1: [promise rejectWithReason:@"Fail"]; break;
+                default: [promise cancelWithReason:@"Cancelled"]; break;
+            }
+        }
+    });
+    for (RXPromise* promise in promises) {
+        XCTAssertFalse(promise.isPending, @"");
+        id result = [promise get];
+        if (promise.isFulfilled) {
+            XCTAssertTrue([result isKindOfClass:[NSNumber class]], @"");
+        }
+        else if (promise.isCancelled) {
+            XCTAssertTrue([result isKindOfClass:[NSError class]] && [result code] == -1, @"");
+        }
+        else {
+            XCTAssertTrue(promise.isRejected, @"");
+            XCTAssertTrue([result isKindOfClass:[NSError class]] && [result code] == -1000, @"");
+        }
+    }
+}
+
+
 #pragma mark - Livetime
 
 - (void) testPromiseMustNotBeDeallocatedIfHandlersSetupAndNotResolved {
@@ -1078,6 +1129,95 @@ static RXPromise* asyncOp(NSString* label, int workCount, NSOperationQueue* queu
 }
 
 
+// When the library has been built with more than one sync queue shard (see
+// Tests/Configurations/Sharded.xcconfig), independent root promises will be
+// assigned to different shards. The following tests bind, chain and cancel
+// promises of many roots, thus across shards. Promises of one chain must share
+// the shard of their root, which the assertions of the library check.
+
+- (void) testBindShouldWorkAcrossRootPromises {
+    
+    const int N = 64;
+    NSMutableArray* promises = [[NSMutableArray alloc] init];
+    NSMutableArray* others = [[NSMutableArray alloc] init];
+    for (int i = 0; i < N; ++i) {
+        RXPromise* promise = [[RXPromise alloc] init];
+        RXPromise* other = [[RXPromise alloc] init];
+        [promise bind:other];
+        [promises addObject:promise];
+        [others addObject:other];
+    }
+    dispatch_apply(N, dispatch_get_global_queue(0, 0), ^(size_t i) {
+        if (i % 2) {
+            [others[i] fulfillWithValue:@(i)];
+        }
+        else {
+            [promises[i] cancel];
+        }
+    });
+    for (int i = 0; i < N; ++i) {
+        RXPromise* promise = promises[i];
+        RXPromise* other = others[i];
+        id result = [promise getWithTimeout:1];
+        [other getWithTimeout:1];
+        if (i % 2) {
+            XCTAssertTrue([result isEqual:@(i)], @"");
+            XCTAssertTrue(other.isFulfilled, @"");
+        }
+        else {
+            XCTAssertTrue(promise.isCancelled, @"");
+            XCTAssertTrue(other.isCancelled, @"bound promise must be cancelled");
+        }
+    }
+}
+
+
+- (void) testChainsShouldResolveAndCancelAcrossRootPromises {
+    
+    const int N = 64;
+    NSMutableArray* roots = [[NSMutableArray alloc] init];
+    NSMutableArray* chains = [[NSMutableArray alloc] init];
+    NSMutableArray* inners = [[NSMutableArray alloc] init];
+    for (int i = 0; i < N; ++i) {
+        RXPromise* root = [[RXPromise alloc] init];
+        RXPromise* inner = [[RXPromise alloc] init];
+        // The handler returns a promise of another root:
+        RXPromise* chain = root.then(^id(id result) {
+            return inner;
+        }, nil)
+        .thenInline(^id(id result) {
+            return @([result intValue] + 1);
+        }, nil)
+        .then(^id(id result) {
+            return @([result intValue] + 1);
+        }, nil);
+        [roots addObject:root];
+        [inners addObject:inner];
+        [chains addObject:chain];
+    }
+    dispatch_apply(N, dispatch_get_global_queue(0, 0), ^(size_t i) {
+        if (i % 2) {
+            [roots[i] fulfillWithValue:@"OK"];
+            [inners[i] fulfillWithValue:@(i)];
+        }
+        else {
+            [roots[i] cancel];
+        }
+    });
+    for (int i = 0; i < N; ++i) {
+        RXPromise* chain = chains[i];
+        id result = [chain getWithTimeout:1];
+        if (i % 2) {
+            XCTAssertTrue([result isEqual:@(i + 2)], @"");
+        }
+        else {
+            XCTAssertTrue(chain.isCancelled, @"cancellation must be forwarded to the children");
+            [inners[i] cancel];
+        }
+    }
+}
+
+
 
 #pragma mark - Success / Failure
 
@@ -3122,6 +3262,110 @@ static RXPromise* asyncOp(NSString* label, int workCount, NSOperationQueue* queu
 }
 
 
+-(void) testCancellationShouldBeForwardedToChildrenOfLongLivedParent {
+    // A resolved parent with many children which already died. Cancelling the
+    // parent must still be forwarded to a child which is alive.
+    RXPromise* parent = [RXPromise promiseWithResult:@"OK"];
+    for (int i = 0; i < 1000; ++i) {
+        @autoreleasepool {
+            [parent.then(nil, nil) wait];
+        }
+    }
+    RXPromise* pending = [[RXPromise alloc] init];
+    dispatch_semaphore_t finished_sem = dispatch_semaphore_create(0);
+    RXPromise* child = parent.then(^id(id result) {
+        dispatch_semaphore_signal(finished_sem);
+        return pending;
+    }, nil);
+    XCTAssertTrue(dispatch_semaphore_wait(finished_sem, dispatch_time(DISPATCH_TIME_NOW, 1*NSEC_PER_SEC)) == 0, @"");
+    usleep(100*1000); // wait until the child has been bound to `pending`
+    [parent cancel];
+    XCTAssertTrue(parent.isFulfilled, @"");
+    [child wait];
+    XCTAssertTrue(child.isCancelled, @"");
+}
+
+
+
+- (void) testCancelShouldTakeEffectSynchronously {
+    
+    RXPromise* promise = [[RXPromise alloc] init];
+    __block NSThread* inlineThread = nil;
+    RXPromise* child = promise.thenInline(nil, ^id(NSError* error) {
+        inlineThread = [NSThread currentThread];
+        return error;
+    });
+    [promise cancel];
+    XCTAssertTrue(promise.isCancelled, @"");
+    XCTAssertTrue(child.isCancelled, @"");
+    XCTAssertTrue(inlineThread == [NSThread currentThread], @"inline handler must run on the cancelling thread before cancel returns");
+}
+
+
+- (void) testConcurrentRejectAndCancelShouldResolveOnce {
+    
+    for (int i = 0; i < 100; ++i) {
+        RXPromise* promise = [[RXPromise alloc] init];
+        RXPromise* child = promise.then(nil, ^id(NSError* error) {
+            return error;
+        });
+        __block int count = 0;
+        promise.thenInline(nil, ^id(NSError* error) {
+            ++count;
+            return nil;
+        });
+        dispatch_apply(2, dispatch_get_global_queue(0, 0), ^(size_t k) {
+            if (k == 0) {
+                [promise rejectWithReason:@"FAIL"];
+            }
+            else {
+                [promise cancel];
+            }
+        });
+        [child getWithTimeout:1];
+        XCTAssertTrue(promise.isRejected, @"");
+        XCTAssertTrue(child.isRejected, @"");
+        XCTAssertTrue(count == 1, @"");
+    }
+}
+
+- (void) testCancelShouldUseSharedError {
+    
+    RXPromise* p1 = [[RXPromise alloc] init];
+    RXPromise* p2 = [[RXPromise alloc] init];
+    [p1 cancel];
+    [p2 cancel];
+    NSError* e1 = [p1 get];
+    NSError* e2 = [p2 get];
+    XCTAssertTrue(e1 == e2, @"");
+    XCTAssertTrue([e1.domain isEqualToString:@"RXPromise"] && e1.code == -1, @"");
+    XCTAssertTrue([[e1 localizedFailureReason] isEqualToString:@"cancelled"], @"");
+}
+
+
+- (void) testReasonShouldBeBoxedOnceWhenObserved {
+    
+    RXPromise* promise = [[RXPromise alloc] init];
+    [promise rejectWithReason:@"Failure"];
+    NSError* e1 = [promise get];
+    NSError* e2 = [promise get];
+    XCTAssertTrue([e1 isKindOfClass:[NSError class]], @"");
+    XCTAssertTrue(e1 == e2, @"");
+    XCTAssertTrue(e1.code == -1000, @"");
+    XCTAssertTrue([[e1 localizedFailureReason] isEqualToString:@"Failure"], @"");
+    
+    RXPromise* cancelled = [[RXPromise alloc] init];
+    [cancelled cancelWithReason:@"Stop"];
+    NSError* reason = [cancelled.then(nil, ^id(NSError* error) {
+        return error;
+    }) get];
+    XCTAssertTrue(reason == [cancelled get], @"");
+    XCTAssertTrue(reason.code == -1, @"");
+    XCTAssertTrue([[reason localizedFailureReason] isEqualToString:@"Stop"], @"");
+}
+
+
+
 #pragma mark - all
 
 -(void) testAllFulfilled1
@@ -3556,6 +3800,49 @@ static RXPromise* asyncOp(NSString* label, int workCount, NSOperationQueue* queu
 
 
 
+-(void) testAllWithManyPromisesShouldPreserveOrder {
+    
+    const NSUInteger count = 10000;
+    NSMutableArray* promises = [[NSMutableArray alloc] initWithCapacity:count];
+    for (NSUInteger i = 0; i < count; ++i) {
+        [promises addObject:[[RXPromise alloc] init]];
+    }
+    RXPromise* all = [RXPromise all:promises];
+    dispatch_apply(count, dispatch_get_global_queue(0, 0), ^(size_t i) {
+        [promises[count - 1 - i] fulfillWithValue:@(count - 1 - i)];
+    });
+    NSArray* results = [all get];
+    XCTAssertTrue([results isKindOfClass:[NSArray class]], @"");
+    XCTAssertTrue([results count] == count, @"");
+    for (NSUInteger i = 0; i < count; ++i) {
+        XCTAssertTrue([results[i] unsignedIntegerValue] == i, @"");
+    }
+}
+
+-(void) testAllShouldReleaseResultsOnFirstRejection {
+    
+    RXPromise* p0 = [[RXPromise alloc] init];
+    RXPromise* p1 = [[RXPromise alloc] init];
+    RXPromise* p2 = [[RXPromise alloc] init];
+    RXPromise* all = [RXPromise all:@[p0, p1, p2]];
+    __weak id weakResult = nil;
+    @autoreleasepool {
+        id result = [[NSObject alloc] init];
+        weakResult = result;
+        [p0 fulfillWithValue:result];
+        p0 = nil;
+    }
+    XCTAssertTrue(weakResult != nil, @"");
+    [p1 rejectWithReason:@"Failure"];
+    [all wait];
+    XCTAssertTrue(all.isRejected, @"");
+    // p2 is still pending, but the result of p0 has been released:
+    XCTAssertTrue(p2.isPending, @"");
+    XCTAssertTrue(weakResult == nil, @"");
+    [p2 fulfillWithValue:@"OK"];
+}
+
+
 #pragma mark - allSettled
 
 -(void) testAllSettledOneRejected1
@@ -3869,6 +4156,66 @@ static RXPromise* asyncOp(NSString* label, int workCount, NSOperationQueue* queu
 }
 
 
+-(void) testAnyWithCancelLosersShouldCancelRootsOfOtherPromises {
+    
+    RXPromise* root0 = [[RXPromise alloc] init];
+    RXPromise* root1 = [[RXPromise alloc] init];
+    RXPromise* root2 = [[RXPromise alloc] init];
+    NSArray* promises = @[root0.then(nil, nil), root1.then(nil, nil), root2];
+    RXPromise* any = [RXPromise any:promises cancelLosers:YES];
+    [root1 fulfillWithValue:@"B"];
+    XCTAssertTrue([@"B" isEqualToString:[any get]], @"");
+    [promises[0] wait];
+    XCTAssertTrue(root0.isCancelled, @"");
+    XCTAssertTrue(root1.isFulfilled, @"");
+    XCTAssertTrue(root2.isCancelled, @"");
+}
+
+-(void) testAnyShouldNotCancelOtherPromisesByDefault {
+    
+    RXPromise* p0 = [[RXPromise alloc] init];
+    RXPromise* p1 = [[RXPromise alloc] init];
+    RXPromise* any = [RXPromise any:@[p0, p1]];
+    [p1 fulfillWithValue:@"B"];
+    XCTAssertTrue([@"B" isEqualToString:[any get]], @"");
+    XCTAssertTrue(p0.isPending, @"");
+    [p0 fulfillWithValue:@"A"];
+}
+
+
+#pragma mark - race
+
+-(void) testRaceShouldAdoptFirstFulfilledPromise {
+    
+    RXPromise* p0 = [[RXPromise alloc] init];
+    RXPromise* p1 = [[RXPromise alloc] init];
+    RXPromise* race = [RXPromise race:@[p0, p1]];
+    [p1 fulfillWithValue:@"B"];
+    [p0 rejectWithReason:@"Failure"];
+    XCTAssertTrue([@"B" isEqualToString:[race get]], @"");
+    XCTAssertTrue(race.isFulfilled, @"");
+}
+
+-(void) testRaceShouldAdoptFirstRejectedPromise {
+    
+    RXPromise* p0 = [[RXPromise alloc] init];
+    RXPromise* p1 = [[RXPromise alloc] init];
+    RXPromise* race = [RXPromise race:@[p0, p1]];
+    [p0 rejectWithReason:@"Failure"];
+    [p1 fulfillWithValue:@"B"];
+    [race wait];
+    XCTAssertTrue(race.isRejected, @"");
+    XCTAssertTrue([@"Failure" isEqualToString:[race.get userInfo][NSLocalizedFailureReasonErrorKey]], @"");
+}
+
+-(void) testRaceWithEmptyArrayShouldReject {
+    
+    RXPromise* race = [RXPromise race:@[]];
+    [race wait];
+    XCTAssertTrue(race.isRejected, @"");
+}
+
+
 
 #pragma mark - API Promises APlus
 
@@ -4340,60 +4687,6 @@ static RXPromise* asyncOp(NSString* label, int workCount, NSOperationQueue* queu
     }) wait];
 }
 
-#include <mach/mach.h>
-#include <mach/mach_time.h>
-
-
-- (void) disabled_testPromisePerformance
-{
-    NSAssert([NSThread currentThread] == [NSThread mainThread], @"this test must run on the main thread");
-    
-    mach_timebase_info_data_t timebase_info;
-    mach_timebase_info(&timebase_info);
-    double clock2ns = ((double)timebase_info.numer / (double)timebase_info.denom);
-    
-    
-    RXPromise* promise = [RXPromise new];
-    dispatch_queue_t syncQueue = dispatch_queue_create("test.sync_queue", DISPATCH_QUEUE_CONCURRENT);
-    
-    __block uint64_t t1;
-    
-    
-    double delayInSeconds = 0.5;
-    dispatch_time_t popTime = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delayInSeconds * NSEC_PER_SEC));
-    dispatch_after(popTime, syncQueue, ^(void) {
-        [promise fulfillWithValue:@"OK"];
-        t1 = mach_absolute_time();
-    });
-    
-    [promise setTimeout:5];
-    [promise runLoopWait];
-
-    NSMutableArray* promises = [[NSMutableArray alloc] init];
-    
-    for (int i = 0; i < 100; ++i) {
-        RXPromise* p = promise.thenOn(syncQueue, ^id(id result) {
-            uint64_t t2 = mach_absolute_time();
-            double d = (t2-t1)*clock2ns*1e-3; // µs
-            return [NSNumber numberWithDouble:d];
-        }, ^id(NSError* error) {
-            XCTFail(@"Error handler not expeted");
-            return error;
-        });
-        [promises addObject:p];
-        
-    }
-    
-    [[RXPromise all:promises].thenOn(dispatch_get_main_queue(), ^id(id result) {
-        uint64_t t = mach_absolute_time();
-        double te = (t-t1)*clock2ns*1e-3; // µs
-        NSLog(@"elapsed time: %.3f µs,\nresults: %@", te, result);
-        return nil;
-    }, ^id(NSError* error) {
-        XCTFail(@"Error %@", error);
-        return error;
-    }) runLoopWait];
-}
 
 
 
@@ -4452,6 +4745,46 @@ static RXPromise* asyncOp(NSString* label, int workCount, NSOperationQueue* queu
 }
 
 
+- (void) testPromiseWithResultShouldInvokeHandlersAndDeallocate
+{
+    for (id result in @[@"OK", [NSError errorWithDomain:@"Test" code:-1 userInfo:nil]]) {
+        __weak RXPromise* weakPromise;
+        __block int thenCount = 0;
+        __block int inlineCount = 0;
+        @autoreleasepool {
+            RXPromise* promise = [RXPromise promiseWithResult:result];
+            weakPromise = promise;
+            RXPromise* p1 = promise.then(^id(id value) {
+                ++thenCount;
+                return nil;
+            }, ^id(NSError* error) {
+                ++thenCount;
+                return nil;
+            });
+            RXPromise* p2 = promise.thenInline(^id(id value) {
+                ++inlineCount;
+                return nil;
+            }, ^id(NSError* error) {
+                ++inlineCount;
+                return nil;
+            });
+            XCTAssertTrue(inlineCount == 1, @"inline handler must run before thenInline returns");
+            [p1 getWithTimeout:1];
+            [p2 getWithTimeout:1];
+            XCTAssertTrue(p1.isFulfilled, @"");
+            XCTAssertTrue(p2.isFulfilled, @"");
+        }
+        XCTAssertTrue(thenCount == 1, @"");
+        XCTAssertTrue(inlineCount == 1, @"");
+        int count = 100;
+        while (weakPromise != nil && count--) {
+            usleep(1000);
+        }
+        XCTAssertTrue(weakPromise == nil, @"promise must be deallocated");
+    }
+}
+
+
 #pragma mark - root
 
 - (void) testRoot
@@ -4594,6 +4927,142 @@ static RXPromise* asyncOp(NSString* label, int workCount, NSOperationQueue* queu
 }
 
 
+#pragma mark - map
+
+
+- (void) testMapShouldLimitConcurrencyAndPreserveOrder
+{
+    const NSUInteger Count = 100;
+    const NSUInteger Concurrency = 4;
+    NSMutableArray* inputs = [[NSMutableArray alloc] initWithCapacity:Count];
+    for (NSUInteger i = 0; i < Count; ++i) {
+        [inputs addObject:@(i)];
+    }
+    std::shared_ptr<std::atomic<NSUInteger>> running = std::make_shared<std::atomic<NSUInteger>>(0);
+    std::shared_ptr<std::atomic<NSUInteger>> maxRunning = std::make_shared<std::atomic<NSUInteger>>(0);
+    
+    RXPromise* finished = [RXPromise map:[inputs objectEnumerator] concurrency:Concurrency task:^RXPromise*(id input) {
+        NSUInteger n = ++*running;
+        NSUInteger m = maxRunning->load();
+        while (n > m && !maxRunning->compare_exchange_weak(m, n)) {}
+        return [RXPromise promiseWithTask:^id{
+            usleep(1000 * (arc4random_uniform(3) + 1));
+            --*running;
+            return @([input unsignedIntegerValue] * 2);
+        }];
+    }];
+    
+    NSArray* results = [finished get];
+    XCTAssertTrue([results isKindOfClass:[NSArray class]], @"%@", results);
+    XCTAssertTrue([results count] == Count, @"");
+    for (NSUInteger i = 0; i < Count; ++i) {
+        XCTAssertTrue([results[i] unsignedIntegerValue] == 2 * i, @"");
+    }
+    XCTAssertTrue(maxRunning->load() <= Concurrency, @"%lu", (unsigned long)maxRunning->load());
+}
+
+
+- (void) testMapWithCancellationShouldCancelRunningTasks
+{
+    NSArray* inputs = @[@"a", @"b", @"c", @"d", @"e", @"f"];
+    NSMutableArray* tasks = [[NSMutableArray alloc] init];
+    dispatch_semaphore_t started = dispatch_semaphore_create(0);
+    
+    RXPromise* finished = [RXPromise map:inputs concurrency:2 task:^RXPromise*(id input) {
+        RXPromise* taskPromise = [[RXPromise alloc] init];
+        @synchronized (tasks) {
+            [tasks addObject:taskPromise];
+        }
+        dispatch_semaphore_signal(started);
+        return taskPromise;
+    }];
+    dispatch_semaphore_wait(started, DISPATCH_TIME_FOREVER);
+    dispatch_semaphore_wait(started, DISPATCH_TIME_FOREVER);
+    [finished cancel];
+    [finished wait];
+    
+    NSArray* startedTasks;
+    @synchronized (tasks) {
+        startedTasks = [tasks copy];
+    }
+    XCTAssertTrue([startedTasks count] == 2, @"");
+    for (RXPromise* p in startedTasks) {
+        [p wait];
+        XCTAssertTrue(p.isCancelled, @"");
+    }
+}
+
+
+- (void) testMapWithFailingTaskShouldReject
+{
+    RXPromise* finished = [RXPromise map:@[@1, @2, @3] concurrency:2 task:^RXPromise*(id input) {
+        if ([input isEqual:@2]) {
+            return [RXPromise promiseWithResult:[NSError errorWithDomain:@"Test" code:-1 userInfo:nil]];
+        }
+        return [RXPromise promiseWithResult:input];
+    }];
+    [finished wait];
+    XCTAssertTrue(finished.isRejected, @"");
+}
+
+
+#pragma mark - parallelMap
+
+
+- (void) testParallelMapShouldMapAllElementsInOrder
+{
+    const NSUInteger Count = 10000;
+    NSMutableArray* inputs = [[NSMutableArray alloc] initWithCapacity:Count];
+    for (NSUInteger i = 0; i < Count; ++i) {
+        [inputs addObject:@(i)];
+    }
+    RXPromise* mapped = [RXPromise parallelMap:inputs chunkSize:16 block:^id(id input, NSUInteger index) {
+        XCTAssertTrue([input unsignedIntegerValue] == index, @"");
+        return @(index * 2);
+    }];
+    NSArray* results = [mapped get];
+    XCTAssertTrue([results count] == Count, @"");
+    for (NSUInteger i = 0; i < Count; ++i) {
+        XCTAssertTrue([results[i] unsignedIntegerValue] == 2 * i, @"");
+    }
+}
+
+
+- (void) testParallelMapWithEmptyArrayShouldFulfillWithEmptyArray
+{
+    RXPromise* mapped = [RXPromise parallelMap:@[] chunkSize:0 block:^id(id input, NSUInteger index) {
+        XCTFail(@"must not be called");
+        return nil;
+    }];
+    XCTAssertTrue([[mapped get] isEqualToArray:@[]], @"");
+}
+
+
+- (void) testParallelMapShouldStopWhenCancelled
+{
+    const NSUInteger Count = 1000;
+    NSMutableArray* inputs = [[NSMutableArray alloc] initWithCapacity:Count];
+    for (NSUInteger i = 0; i < Count; ++i) {
+        [inputs addObject:@(i)];
+    }
+    std::shared_ptr<std::atomic<NSUInteger>> invocations = std::make_shared<std::atomic<NSUInteger>>(0);
+    dispatch_semaphore_t sem = dispatch_semaphore_create(0);
+    RXPromise* mapped = [RXPromise parallelMap:inputs chunkSize:1 block:^id(id input, NSUInteger index) {
+        if (++*invocations == 1) {
+            dispatch_semaphore_wait(sem, DISPATCH_TIME_FOREVER);
+        }
+        usleep(100);
+        return input;
+    }];
+    [mapped cancel];
+    dispatch_semaphore_signal(sem);
+    [mapped wait];
+    XCTAssertTrue(mapped.isCancelled, @"");
+    usleep(10000);
+    XCTAssertTrue(invocations->load() < Count, @"");
+}
+
+
 #pragma mark repeat
 
 - (void) testRepeat
@@ -4736,6 +5205,75 @@ static RXPromise* asyncOp(NSString* label, int workCount, NSOperationQueue* queu
 
 
 
+#pragma mark - retry
+
+
+- (void) testRetryShouldFulfillWithFirstSuccessfulAttempt {
+    
+    __block NSUInteger attempts = 0;
+    RXPromise* promise = [RXPromise retry:^RXPromise *(NSUInteger attempt) {
+        attempts = attempt;
+        if (attempt < 3) {
+            RXPromise* failed = [[RXPromise alloc] init];
+            [failed rejectWithReason:@"Failure"];
+            return failed;
+        }
+        return [RXPromise promiseWithResult:@"OK"];
+    } maxAttempts:5 backoff:0.001 shouldRetry:nil];
+    XCTAssertTrue([[promise get] isEqual:@"OK"], @"");
+    XCTAssertTrue(attempts == 3, @"");
+}
+
+
+- (void) testRetryShouldStopAfterMaxAttempts {
+    
+    __block NSUInteger attempts = 0;
+    RXPromise* promise = [RXPromise retry:^RXPromise *(NSUInteger attempt) {
+        attempts = attempt;
+        RXPromise* failed = [[RXPromise alloc] init];
+        [failed rejectWithReason:@"Failure"];
+        return failed;
+    } maxAttempts:3 backoff:0.001 shouldRetry:nil];
+    [promise wait];
+    XCTAssertTrue(promise.isRejected, @"");
+    XCTAssertTrue(attempts == 3, @"");
+}
+
+
+- (void) testRetryShouldStopWhenShouldRetryReturnsNo {
+    
+    __block NSUInteger attempts = 0;
+    RXPromise* promise = [RXPromise retry:^RXPromise *(NSUInteger attempt) {
+        attempts = attempt;
+        RXPromise* failed = [[RXPromise alloc] init];
+        [failed rejectWithReason:@"Permanent"];
+        return failed;
+    } maxAttempts:10 backoff:0.001 shouldRetry:^BOOL(NSError *error, NSUInteger attempt) {
+        return ![[error localizedFailureReason] isEqualToString:@"Permanent"];
+    }];
+    [promise wait];
+    XCTAssertTrue(promise.isRejected, @"");
+    XCTAssertTrue(attempts == 1, @"");
+}
+
+
+- (void) testCancelledRetryShouldNotStartFurtherAttempts {
+    
+    __block NSUInteger attempts = 0;
+    RXPromise* attempt1 = [[RXPromise alloc] init];
+    RXPromise* promise = [RXPromise retry:^RXPromise *(NSUInteger attempt) {
+        attempts = attempt;
+        return attempt1;
+    } maxAttempts:10 backoff:0.001 shouldRetry:nil];
+    [promise cancel];
+    [promise wait];
+    [attempt1 wait];
+    XCTAssertTrue(attempt1.isCancelled, @"");
+    [NSThread sleepForTimeInterval:0.05];
+    XCTAssertTrue(attempts == 1, @"");
+}
+
+
 #pragma mark Concurrent Handler Queue
 - (void) testConcurrentHandlerQueue {
     
@@ -4794,7 +5332,76 @@ static RXPromise* asyncOp(NSString* label, int workCount, NSOperationQueue* queu
 #pragma mark - Execution Context
 
 
-- (void) testExecutionContextWithMainThread {
+- (void) testHandlersOnResolvedPromiseShouldRunInOrderOfRegistration {
+    
+    RXPromise* promise = [RXPromise promiseWithResult:@"OK"];
+    dispatch_queue_t queue = dispatch_queue_create("test.serial_queue", NULL);
+    NSMutableString* s = [[NSMutableString alloc] init];
+    RXPromise* last = nil;
+    for (int i = 0; i < 10; ++i) {
+        last = promise.thenOn(queue, ^id(id result) {
+            XCTAssertTrue([@"OK" isEqualToString:result], @"");
+            [s appendFormat:@"%d", i];
+            return nil;
+        }, nil);
+    }
+    [last wait];
+    XCTAssertTrue([s isEqualToString:@"0123456789"], @"%@", s);
+}
+
+
+- (void) testThenInlineShouldExecuteHandlerOnResolvingThread {
+    
+    RXPromise* promise = [[RXPromise alloc] init];
+    __block NSThread* resolvingThread = nil;
+    __block NSThread* handlerThread = nil;
+    RXPromise* child = promise.thenInline(^id(id result) {
+        handlerThread = [NSThread currentThread];
+        return [result stringByAppendingString:@"!"];
+    }, nil);
+    
+    dispatch_async(dispatch_get_global_queue(0, 0), ^{
+        resolvingThread = [NSThread currentThread];
+        [promise fulfillWithValue:@"OK"];
+        // The child is resolved when the resolver returns:
+        XCTAssertTrue(child.isFulfilled, @"");
+    });
+    
+    XCTAssertTrue([@"OK!" isEqualToString:[child get]], @"");
+    XCTAssertTrue(handlerThread == resolvingThread, @"");
+}
+
+
+- (void) testThenInlineOnResolvedPromiseShouldExecuteHandlerImmediately {
+    
+    RXPromise* promise = [RXPromise promiseWithResult:@"OK"];
+    __block BOOL executed = NO;
+    RXPromise* child = promise.thenInline(^id(id result) {
+        executed = YES;
+        return nil;
+    }, nil);
+    XCTAssertTrue(executed, @"");
+    XCTAssertTrue(child.isFulfilled, @"");
+}
+
+
+- (void) testLongChainOfInlineHandlersShouldNotOverflowTheStack {
+    
+    RXPromise* root = [[RXPromise alloc] init];
+    RXPromise* promise = root;
+    const int count = 10000;
+    for (int i = 0; i < count; ++i) {
+        promise = promise.thenInline(^id(id result) {
+            return @([result intValue] + 1);
+        }, nil);
+    }
+    [root fulfillWithValue:@0];
+    XCTAssertTrue(promise.isFulfilled, @"");
+    XCTAssertTrue([[promise get] intValue] == count, @"");
+}
+
+
+- (void) testExecutionContextWithMainThread {
     
     RXPromise* promise = [[RXPromise alloc] init];
     
@@ -4931,6 +5538,907 @@ static RXPromise* asyncOp(NSString* label, int workCount, NSOperationQueue* queu
 }
 
 
+#pragma mark - Statistics
+
+
+- (void) testStatisticsShouldBeEnabledByDefault {
+    
+    XCTAssertTrue([RXPromise statisticsEnabled], @"");
+}
+
+
+- (void) testStatisticsShouldCountPromisesAndHandlers {
+    
+    [RXPromise setStatisticsEnabled:YES];
+    [RXPromise resetStatistics];
+    
+    RXPromise* promise = [[RXPromise alloc] init];
+    RXPromise* child = promise.then(^id(id result) {
+        return nil;
+    }, nil);
+    RXPromise* inlineChild = promise.thenInline(^id(id result) {
+        return nil;
+    }, nil);
+    [promise fulfillWithValue:@"OK"];
+    [child wait];
+    [inlineChild wait];
+    
+    NSDictionary* stats = [RXPromise statistics];
+    XCTAssertTrue([stats[@"created"] unsignedLongLongValue] >= 3, @"%@", stats);
+    XCTAssertTrue([stats[@"fulfilled"] unsignedLongLongValue] >= 3, @"%@", stats);
+    XCTAssertTrue([stats[@"dispatched"][@"concurrent"] unsignedLongLongValue] >= 1, @"%@", stats);
+    XCTAssertTrue([stats[@"dispatched"][@"inline"] unsignedLongLongValue] >= 1, @"%@", stats);
+    // Latencies are sampled, but the first event after a reset is recorded.
+    XCTAssertTrue([stats[@"handlerLatency"][@"count"] unsignedLongLongValue] >= 1, @"%@", stats);
+    XCTAssertTrue([stats[@"handlerLatency"][@"buckets"] count] > 0, @"%@", stats);
+}
+
+
+- (void) testHandlersOnResolvedPromiseShouldBeDispatchedOnce {
+    
+    [RXPromise setStatisticsEnabled:YES];
+    [RXPromise resetStatistics];
+    
+    __block int count = 0;
+    RXPromise* promise = [RXPromise promiseWithResult:@"OK"];
+    RXPromise* child = promise.then(^id(id result) {
+        ++count;
+        return nil;
+    }, nil);
+    RXPromise* inlineChild = promise.thenInline(^id(id result) {
+        ++count;
+        return nil;
+    }, nil);
+    [child getWithTimeout:1];
+    [inlineChild getWithTimeout:1];
+    
+    NSDictionary* stats = [RXPromise statistics];
+    XCTAssertTrue(count == 2, @"");
+    XCTAssertTrue([stats[@"dispatched"][@"concurrent"] unsignedLongLongValue] == 1, @"%@", stats);
+    XCTAssertTrue([stats[@"dispatched"][@"inline"] unsignedLongLongValue] == 1, @"%@", stats);
+    XCTAssertTrue([stats[@"handlerLatency"][@"count"] unsignedLongLongValue] >= 1, @"%@", stats);
+    XCTAssertTrue([stats[@"handlerLatency"][@"count"] unsignedLongLongValue] <= 2, @"%@", stats);
+}
+
+
+- (void) testDisabledStatisticsShouldNotCount {
+    
+    [RXPromise setStatisticsEnabled:NO];
+    [RXPromise resetStatistics];
+    RXPromise* promise = [RXPromise promiseWithResult:@"OK"];
+    [promise.then(nil, nil) wait];
+    NSDictionary* stats = [RXPromise statistics];
+    [RXPromise setStatisticsEnabled:YES];
+    
+    XCTAssertTrue([stats[@"created"] unsignedLongLongValue] == 0, @"%@", stats);
+    XCTAssertTrue([stats[@"handlerLatency"][@"count"] unsignedLongLongValue] == 0, @"%@", stats);
+}
+
+
+
+#pragma mark - Pooling
+
+
+- (void) testPoolingShouldBeOptIn {
+    
+    XCTAssertFalse([RXPromise poolingEnabled], @"");
+    [RXPromise setPoolingEnabled:YES];
+    RXPromise* root = [[RXPromise alloc] init];
+    RXPromise* promise = root;
+    for (int i = 0; i < 100; ++i) {
+        promise = promise.then(^id(id result) {
+            return @([result intValue] + 1);
+        }, nil);
+    }
+    [root fulfillWithValue:@0];
+    id result = [promise get];
+    // Records allocated while pooling was enabled may be released afterwards:
+    [RXPromise setPoolingEnabled:NO];
+    XCTAssertTrue([result isEqual:@100], @"%@", result);
+}
+
+
+
+#pragma mark - Tracing
+
+
+- (void) testTraceEventsShouldContainLifeCycleOfPromise {
+    
+    [RXPromise setTracingEnabled:YES];
+    [RXPromise clearTrace];
+    
+    RXPromise* promise = [[RXPromise alloc] init];
+    RXPromise* child = promise.then(^id(id result) {
+        return result;
+    }, nil);
+    [promise fulfillWithValue:@"OK"];
+    [child wait];
+    [RXPromise setTracingEnabled:NO];
+    
+    NSData* data = [RXPromise traceEvents];
+    NSError* error;
+    NSDictionary* trace = [NSJSONSerialization JSONObjectWithData:data options:0 error:&error];
+    XCTAssertTrue(trace != nil, @"%@", error);
+    NSString* promiseID = [NSString stringWithFormat:@"0x%llx", (unsigned long long)(uintptr_t)(__bridge void*)promise];
+    NSString* childID = [NSString stringWithFormat:@"0x%llx", (unsigned long long)(uintptr_t)(__bridge void*)child];
+    NSMutableSet* names = [[NSMutableSet alloc] init];
+    for (NSDictionary* event in trace[@"traceEvents"]) {
+        if ([event[@"args"][@"promise"] isEqualToString:promiseID]) {
+            [names addObject:[NSString stringWithFormat:@"%@:%@", event[@"name"], event[@"ph"]]];
+        }
+        if ([event[@"args"][@"promise"] isEqualToString:childID] && [event[@"name"] isEqualToString:@"resolve"]) {
+            XCTAssertTrue([event[@"args"][@"parent"] isEqualToString:promiseID], @"%@", event);
+        }
+    }
+    NSSet* expected = [NSSet setWithObjects:@"create:i", @"register:i", @"resolve:i", @"handler:B", @"handler:E", nil];
+    XCTAssertTrue([expected isSubsetOfSet:names], @"%@", names);
+}
+
+
+
+#pragma mark - RXStream
+
+
+- (void) testStreamToArrayShouldCollectAllValues {
+    
+    RXStream* stream = [RXStream streamWithArray:@[@"a", @"b", @"c"]];
+    NSArray* values = [[stream toArray] get];
+    XCTAssertTrue([values isEqualToArray:(@[@"a", @"b", @"c"])], @"%@", values);
+}
+
+
+- (void) testStreamShouldDeliverOnlyRequestedValues {
+    
+    RXStream* stream = [[RXStream alloc] init];
+    dispatch_queue_t queue = dispatch_queue_create("test.stream", NULL);
+    NSMutableArray* values = [[NSMutableArray alloc] init];
+    dispatch_semaphore_t sem = dispatch_semaphore_create(0);
+    [stream subscribeOn:queue onValue:^(id value) {
+        [values addObject:value];
+        dispatch_semaphore_signal(sem);
+    } onCompletion:^(NSError *error) {
+        XCTAssertTrue(error == nil, @"");
+        dispatch_semaphore_signal(sem);
+    }];
+    [stream sendValue:@1];
+    [stream sendValue:@2];
+    [stream sendValue:@3];
+    [stream complete];
+    XCTAssertTrue(stream.demand == 0, @"");
+    [stream request:2];
+    dispatch_semaphore_wait(sem, DISPATCH_TIME_FOREVER);
+    dispatch_semaphore_wait(sem, DISPATCH_TIME_FOREVER);
+    XCTAssertTrue(0 != dispatch_semaphore_wait(sem, dispatch_time(DISPATCH_TIME_NOW, 0.05 * NSEC_PER_SEC)), @"");
+    dispatch_sync(queue, ^{
+        XCTAssertTrue([values isEqualToArray:(@[@1, @2])], @"%@", values);
+    });
+    [stream request:1];
+    // The third value and the completion:
+    dispatch_semaphore_wait(sem, DISPATCH_TIME_FOREVER);
+    dispatch_semaphore_wait(sem, DISPATCH_TIME_FOREVER);
+    dispatch_sync(queue, ^{
+        XCTAssertTrue([values isEqualToArray:(@[@1, @2, @3])], @"%@", values);
+    });
+}
+
+
+- (void) testStreamDemandHandlerShouldBeInvokedWithRequestedValues {
+    
+    RXStream* stream = [[RXStream alloc] init];
+    __block NSUInteger requested = 0;
+    [stream setDemandHandler:^(NSUInteger n) {
+        requested += n;
+    }];
+    [stream subscribeOn:nil onValue:^(id value) {} onCompletion:^(NSError *error) {}];
+    [stream request:3];
+    [stream request:4];
+    XCTAssertTrue(requested == 7, @"");
+    XCTAssertTrue(stream.demand == 7, @"");
+    [stream cancel];
+}
+
+
+- (void) testStreamFirstShouldCancelStream {
+    
+    RXStream* stream = [[RXStream alloc] init];
+    RXPromise* cancelled = [[RXPromise alloc] init];
+    [stream setCancellationHandler:^(NSError *reason) {
+        [cancelled fulfillWithValue:reason];
+    }];
+    [stream setDemandHandler:^(NSUInteger n) {
+        [stream sendValue:@"first"];
+    }];
+    RXPromise* first = [stream first];
+    XCTAssertTrue([@"first" isEqualToString:[first get]], @"");
+    XCTAssertTrue([[cancelled get] isKindOfClass:[NSError class]], @"");
+    XCTAssertTrue(stream.isCancelled, @"");
+}
+
+
+- (void) testStreamFailureShouldRejectToArray {
+    
+    RXStream* stream = [[RXStream alloc] init];
+    RXPromise* array = [stream toArray];
+    [stream sendValue:@"a"];
+    [stream failWithReason:@"Failure"];
+    [array wait];
+    XCTAssertTrue(array.isRejected, @"");
+}
+
+
+- (void) testStreamWithPromiseShouldSendValueOfPromise {
+    
+    RXPromise* promise = [[RXPromise alloc] init];
+    RXStream* stream = [RXStream streamWithPromise:promise];
+    RXPromise* array = [stream toArray];
+    [promise fulfillWithValue:@"OK"];
+    XCTAssertTrue([[array get] isEqualToArray:@[@"OK"]], @"");
+}
+
+
+- (void) testCancellingToArrayShouldCancelStreamAndPromise {
+    
+    RXPromise* promise = [[RXPromise alloc] init];
+    RXStream* stream = [RXStream streamWithPromise:promise];
+    RXPromise* array = [stream toArray];
+    [array cancel];
+    [promise wait];
+    XCTAssertTrue(stream.isCancelled, @"");
+    XCTAssertTrue(promise.isCancelled, @"");
+}
+
+
+#pragma mark - RXChannel
+
+
+- (void) testChannelShouldDeliverValuesInOrder {
+    
+    RXChannel* channel = [RXChannel channelWithCapacity:2];
+    RXPromise* s1 = [channel send:@1];
+    RXPromise* s2 = [channel send:@2];
+    XCTAssertTrue(s1.isFulfilled && s2.isFulfilled, @"");
+    XCTAssertTrue(channel.count == 2, @"");
+    XCTAssertTrue([[[channel receive] get] isEqual:@1], @"");
+    XCTAssertTrue([[[channel receive] get] isEqual:@2], @"");
+    XCTAssertTrue(channel.count == 0, @"");
+}
+
+
+- (void) testChannelSendShouldWaitForBufferSpace {
+    
+    RXChannel* channel = [RXChannel channelWithCapacity:1];
+    [channel send:@1];
+    RXPromise* s2 = [channel send:@2];
+    XCTAssertTrue(s2.isPending, @"");
+    XCTAssertTrue([[[channel receive] get] isEqual:@1], @"");
+    XCTAssertTrue([[s2 get] isEqual:@2], @"");
+    XCTAssertTrue(channel.count == 1, @"");
+    XCTAssertTrue([[[channel receive] get] isEqual:@2], @"");
+}
+
+
+- (void) testUnbufferedChannelShouldHandOverValues {
+    
+    RXChannel* channel = [[RXChannel alloc] initWithCapacity:0];
+    RXPromise* r = [channel receive];
+    XCTAssertTrue(r.isPending, @"");
+    RXPromise* s = [channel send:@"a"];
+    XCTAssertTrue([[r get] isEqual:@"a"], @"");
+    XCTAssertTrue(s.isFulfilled, @"");
+    
+    RXPromise* s2 = [channel send:@"b"];
+    XCTAssertTrue(s2.isPending, @"");
+    XCTAssertTrue([[[channel receive] get] isEqual:@"b"], @"");
+    XCTAssertTrue(s2.isFulfilled, @"");
+}
+
+
+- (void) testCancelledReceiveShouldNotTakeValue {
+    
+    RXChannel* channel = [RXChannel channelWithCapacity:1];
+    RXPromise* r1 = [channel receive];
+    [r1 cancel];
+    [r1 wait];
+    [channel send:@"a"];
+    XCTAssertTrue(channel.count == 1, @"");
+    XCTAssertTrue([[[channel receive] get] isEqual:@"a"], @"");
+}
+
+
+- (void) testCancelledSendShouldNotBeReceived {
+    
+    RXChannel* channel = [RXChannel channelWithCapacity:0];
+    RXPromise* s1 = [channel send:@1];
+    RXPromise* s2 = [channel send:@2];
+    XCTAssertTrue(s1.isPending && s2.isPending, @"");
+    [s1 cancel];
+    [s1 wait];
+    XCTAssertTrue([[[channel receive] get] isEqual:@2], @"");
+    XCTAssertTrue(s2.isFulfilled, @"");
+    RXPromise* r = [channel receive];
+    XCTAssertTrue(r.isPending, @"");
+    [r cancel];
+    
+    // Cancel blocked sends concurrently with receives: a value which has been
+    // received must have been sent.
+    const int Count = 1000;
+    RXChannel* buffered = [RXChannel channelWithCapacity:1];
+    [buffered send:@(-1)];
+    NSMutableArray* sends = [NSMutableArray arrayWithCapacity:Count];
+    for (int i = 0; i < Count; ++i) {
+        [sends addObject:[buffered send:@(i)]];
+    }
+    dispatch_queue_t queue = dispatch_get_global_queue(0, 0);
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_group_async(group, queue, ^{
+        for (RXPromise* send in sends) {
+            [send cancel];
+        }
+    });
+    NSMutableArray* received = [NSMutableArray array];
+    dispatch_group_async(group, queue, ^{
+        for (;;) {
+            RXPromise* r = [buffered receive];
+            [r getWithTimeout:0.1];
+            if (!r.isFulfilled) {
+                [r cancel];
+                break;
+            }
+            [received addObject:[r get]];
+        }
+    });
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    for (id value in received) {
+        int i = [value intValue];
+        if (i >= 0) {
+            XCTAssertTrue(((RXPromise*)sends[i]).isFulfilled, @"%d", i);
+        }
+    }
+}
+
+
+- (void) testCloseShouldRejectSendsAndDrainedReceives {
+    
+    RXChannel* channel = [RXChannel channelWithCapacity:1];
+    [channel send:@1];
+    RXPromise* waitingSend = [channel send:@2];
+    [channel close];
+    [waitingSend wait];
+    XCTAssertTrue(waitingSend.isRejected, @"");
+    RXPromise* s3 = [channel send:@3];
+    [s3 wait];
+    XCTAssertTrue(s3.isRejected, @"");
+    XCTAssertTrue([[[channel receive] get] isEqual:@1], @"");
+    RXPromise* r = [channel receive];
+    [r wait];
+    XCTAssertTrue(r.isRejected, @"");
+}
+
+
+- (void) testChannelWithManyProducersAndConsumers {
+    
+    const int Producers = 4;
+    const int Consumers = 4;
+    const int Count = 1000;
+    RXChannel* channel = [RXChannel channelWithCapacity:8];
+    dispatch_queue_t queue = dispatch_get_global_queue(0, 0);
+    dispatch_group_t group = dispatch_group_create();
+    for (int p = 0; p < Producers; ++p) {
+        dispatch_group_async(group, queue, ^{
+            for (int i = 0; i < Count; ++i) {
+                [[channel send:@(i)] wait];
+            }
+        });
+    }
+    __block int64_t sum = 0;
+    dispatch_semaphore_t sumLock = dispatch_semaphore_create(1);
+    for (int c = 0; c < Consumers; ++c) {
+        dispatch_group_async(group, queue, ^{
+            for (int i = 0; i < Count; ++i) {
+                id value = [[channel receive] get];
+                dispatch_semaphore_wait(sumLock, DISPATCH_TIME_FOREVER);
+                sum += [value intValue];
+                dispatch_semaphore_signal(sumLock);
+            }
+        });
+    }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    XCTAssertTrue(sum == (int64_t)Producers * Count * (Count - 1) / 2, @"%lld", sum);
+    XCTAssertTrue(channel.count == 0, @"");
+}
+
+
+#pragma mark - RXBatcher
+
+
+- (void) testBatcherShouldCoalesceKeysWithinWindow {
+    
+    __block int batches = 0;
+    RXBatcher* batcher = [[RXBatcher alloc] initWithMaxBatchSize:0 window:0.05 task:^RXPromise *(NSArray *keys) {
+        ++batches;
+        NSMutableArray* results = [[NSMutableArray alloc] init];
+        for (NSString* key in keys) {
+            [results addObject:[key uppercaseString]];
+        }
+        return [RXPromise promiseWithResult:results];
+    }];
+    RXPromise* a = [batcher load:@"a"];
+    RXPromise* b = [batcher load:@"b"];
+    RXPromise* a2 = [batcher load:@"a"];
+    XCTAssertTrue([[a get] isEqual:@"A"], @"");
+    XCTAssertTrue([[b get] isEqual:@"B"], @"");
+    XCTAssertTrue([[a2 get] isEqual:@"A"], @"");
+    XCTAssertTrue(batches == 1, @"");
+}
+
+
+- (void) testBatcherShouldStartFullBatchImmediately {
+    
+    NSMutableArray* batches = [[NSMutableArray alloc] init];
+    RXBatcher* batcher = [[RXBatcher alloc] initWithMaxBatchSize:2 window:1000 task:^RXPromise *(NSArray *keys) {
+        @synchronized (batches) {
+            [batches addObject:keys];
+        }
+        return [RXPromise promiseWithResult:keys];
+    }];
+    RXPromise* p1 = [batcher load:@1];
+    RXPromise* p2 = [batcher load:@2];
+    RXPromise* p3 = [batcher load:@3];
+    XCTAssertTrue([[p1 get] isEqual:@1], @"");
+    XCTAssertTrue([[p2 get] isEqual:@2], @"");
+    XCTAssertTrue(p3.isPending, @"");
+    [batcher flush];
+    XCTAssertTrue([[p3 get] isEqual:@3], @"");
+    @synchronized (batches) {
+        XCTAssertTrue([batches isEqualToArray:(@[@[@1, @2], @[@3]])], @"%@", batches);
+    }
+}
+
+
+- (void) testBatcherShouldRejectPerKeyErrors {
+    
+    RXBatcher* batcher = [[RXBatcher alloc] initWithMaxBatchSize:0 window:0 task:^RXPromise *(NSArray *keys) {
+        return [RXPromise promiseWithResult:@{@"ok": @"value", @"bad": [NSError errorWithDomain:@"Test" code:-1 userInfo:nil]}];
+    }];
+    RXPromise* ok = [batcher load:@"ok"];
+    RXPromise* bad = [batcher load:@"bad"];
+    RXPromise* missing = [batcher load:@"missing"];
+    XCTAssertTrue([[ok get] isEqual:@"value"], @"");
+    [bad wait];
+    XCTAssertTrue(bad.isRejected, @"");
+    XCTAssertTrue([[bad get] code] == -1, @"");
+    [missing wait];
+    XCTAssertTrue(missing.isRejected, @"");
+}
+
+
+- (void) testBatcherShouldRejectAllKeysWhenBatchFails {
+    
+    RXBatcher* batcher = [[RXBatcher alloc] initWithMaxBatchSize:0 window:0 task:^RXPromise *(NSArray *keys) {
+        RXPromise* promise = [[RXPromise alloc] init];
+        [promise rejectWithReason:@"Failure"];
+        return promise;
+    }];
+    RXPromise* p1 = [batcher load:@1];
+    RXPromise* p2 = [batcher load:@2];
+    [p1 wait];
+    [p2 wait];
+    XCTAssertTrue(p1.isRejected && p2.isRejected, @"");
+}
+
+
+#pragma mark - RXPromiseCache
+
+
+- (void) testCacheShouldDeduplicateConcurrentRequests {
+    
+    RXPromiseCache* cache = [[RXPromiseCache alloc] initWithCapacity:10 timeToLive:0];
+    __block int started = 0;
+    RXPromise* task = [[RXPromise alloc] init];
+    RXPromise* (^start)(void) = ^RXPromise*{
+        ++started;
+        return task;
+    };
+    RXPromise* p1 = [cache promiseForKey:@"key" task:start];
+    RXPromise* p2 = [cache promiseForKey:@"key" task:start];
+    XCTAssertTrue(p1 == p2, @"");
+    XCTAssertTrue(started == 1, @"");
+    [task fulfillWithValue:@"OK"];
+    XCTAssertTrue([[p1 get] isEqual:@"OK"], @"");
+    RXPromise* p3 = [cache promiseForKey:@"key" task:start];
+    XCTAssertTrue(p3 == p1, @"");
+    XCTAssertTrue(p3.isFulfilled, @"");
+    XCTAssertTrue(started == 1, @"");
+}
+
+
+- (void) testCacheShouldDropRejectedPromises {
+    
+    RXPromiseCache* cache = [[RXPromiseCache alloc] initWithCapacity:10 timeToLive:0];
+    RXPromise* p1 = [cache promiseForKey:@"key" task:^RXPromise *{
+        RXPromise* promise = [[RXPromise alloc] init];
+        [promise rejectWithReason:@"Failure"];
+        return promise;
+    }];
+    [p1 wait];
+    XCTAssertTrue(p1.isRejected, @"");
+    // The entry will be removed by an internal handler:
+    for (int i = 0; i < 100 && [cache cachedPromiseForKey:@"key"]; ++i) {
+        usleep(1000);
+    }
+    XCTAssertTrue([cache cachedPromiseForKey:@"key"] == nil, @"");
+    RXPromise* p2 = [cache promiseForKey:@"key" task:^RXPromise *{
+        return [RXPromise promiseWithResult:@"OK"];
+    }];
+    XCTAssertTrue([[p2 get] isEqual:@"OK"], @"");
+}
+
+
+- (void) testCacheShouldEvictLeastRecentlyUsedPromise {
+    
+    RXPromiseCache* cache = [[RXPromiseCache alloc] initWithCapacity:2 timeToLive:0];
+    for (NSString* key in @[@"a", @"b"]) {
+        [[cache promiseForKey:key task:^RXPromise *{
+            return [RXPromise promiseWithResult:key];
+        }] wait];
+    }
+    // Wait until both entries have been recorded as fulfilled, then use "a":
+    [NSThread sleepForTimeInterval:0.05];
+    XCTAssertTrue([cache cachedPromiseForKey:@"a"] != nil, @"");
+    [[cache promiseForKey:@"c" task:^RXPromise *{
+        return [RXPromise promiseWithResult:@"c"];
+    }] wait];
+    [NSThread sleepForTimeInterval:0.05];
+    XCTAssertTrue([cache cachedPromiseForKey:@"a"] != nil, @"");
+    XCTAssertTrue([cache cachedPromiseForKey:@"b"] == nil, @"");
+    XCTAssertTrue([cache cachedPromiseForKey:@"c"] != nil, @"");
+}
+
+
+- (void) testCacheShouldExpirePromises {
+    
+    RXPromiseCache* cache = [[RXPromiseCache alloc] initWithCapacity:0 timeToLive:0.05];
+    [[cache promiseForKey:@"key" task:^RXPromise *{
+        return [RXPromise promiseWithResult:@"OK"];
+    }] wait];
+    [NSThread sleepForTimeInterval:0.1];
+    XCTAssertTrue([cache cachedPromiseForKey:@"key"] == nil, @"");
+    XCTAssertTrue(cache.count == 0, @"");
+}
+
+
+- (void) testExpiredPromisesShouldBeRemovedWithoutLookup {
+    
+    RXPromiseCache* cache = [[RXPromiseCache alloc] initWithCapacity:0 timeToLive:0.05];
+    for (NSString* key in @[@"a", @"b", @"c"]) {
+        [[cache promiseForKey:key task:^RXPromise *{
+            return [RXPromise promiseWithResult:key];
+        }] wait];
+    }
+    // Only `count` is queried, which does not check the expiry:
+    for (int i = 0; i < 100 && cache.count != 0; ++i) {
+        usleep(10000);
+    }
+    XCTAssertTrue(cache.count == 0, @"%lu", (unsigned long)cache.count);
+}
+
+
+#pragma mark - RXPromiseGroup
+
+
+- (void) testCancellingGroupShouldCancelPendingPromises {
+    
+    RXPromiseGroup* group = [[RXPromiseGroup alloc] init];
+    NSMutableArray* promises = [[NSMutableArray alloc] init];
+    for (int i = 0; i < 1000; ++i) {
+        RXPromise* promise = [[RXPromise alloc] init];
+        [promises addObject:promise];
+        [group addPromise:promise];
+    }
+    RXPromise* fulfilled = [[RXPromise alloc] init];
+    [group addPromise:fulfilled];
+    [fulfilled fulfillWithValue:@"OK"];
+    [group cancelWithReason:@"scope ended"];
+    XCTAssertTrue(group.isCancelled, @"");
+    for (RXPromise* promise in promises) {
+        [promise wait];
+        XCTAssertTrue(promise.isCancelled, @"");
+        XCTAssertTrue([[[promise get] localizedFailureReason] isEqualToString:@"scope ended"], @"");
+    }
+    XCTAssertTrue(fulfilled.isFulfilled, @"");
+}
+
+
+- (void) testPromiseAddedToCancelledGroupShouldBeCancelled {
+    
+    RXPromiseGroup* group = [[RXPromiseGroup alloc] init];
+    [group cancel];
+    RXPromise* promise = [[RXPromise alloc] init];
+    [group addPromise:promise];
+    XCTAssertTrue(promise.isCancelled, @"");
+    XCTAssertTrue(group.cancellationReason == [promise get], @"");
+}
+
+
+- (void) testGroupShouldInvokeCancellationHandlers {
+    
+    RXPromiseGroup* group = [[RXPromiseGroup alloc] init];
+    __block int invoked = 0;
+    __block BOOL invokedOnCancellingThread = NO;
+    NSThread* cancellingThread = [NSThread currentThread];
+    dispatch_semaphore_t sem = dispatch_semaphore_create(0);
+    [group addCancellationHandler:^(NSError *reason) {
+        ++invoked;
+        invokedOnCancellingThread = [NSThread currentThread] == cancellingThread;
+        dispatch_semaphore_signal(sem);
+    }];
+    // Adding many short lived promises compacts the group, but keeps the handler:
+    for (int i = 0; i < 1000; ++i) {
+        @autoreleasepool {
+            [group addPromise:[[RXPromise alloc] init]];
+        }
+    }
+    XCTAssertTrue(invoked == 0, @"");
+    [group cancel];
+    // The handlers of the members will be invoked asynchronously:
+    dispatch_semaphore_wait(sem, DISPATCH_TIME_FOREVER);
+    XCTAssertTrue(invoked == 1, @"");
+    XCTAssertFalse(invokedOnCancellingThread, @"");
+    [group cancel];
+    [group addCancellationHandler:^(NSError *reason) {
+        ++invoked;
+    }];
+    XCTAssertTrue(invoked == 2, @"");
+}
+
+
+- (void) testConcurrentlyAddedPromisesShouldBeCancelled {
+    
+    RXPromiseGroup* group = [[RXPromiseGroup alloc] init];
+    NSMutableArray* promises = [[NSMutableArray alloc] init];
+    for (int i = 0; i < 4000; ++i) {
+        [promises addObject:[[RXPromise alloc] init]];
+    }
+    dispatch_apply(4, dispatch_get_global_queue(0, 0), ^(size_t n) {
+        for (NSUInteger i = n * 1000; i < (n + 1) * 1000; ++i) {
+            [group addPromise:promises[i]];
+            if (n == 0 && i == 500) {
+                [group cancel];
+            }
+        }
+    });
+    for (RXPromise* promise in promises) {
+        [promise wait];
+        XCTAssertTrue(promise.isCancelled, @"");
+    }
+}
+
+
+#pragma mark - RXFuture
+
+
+- (void) testFutureShouldChainTypedValues {
+    
+    rxpromise::promise<int> p;
+    rxpromise::future<std::string> f = p.get_future()
+    .then([](int x) { return x * 2; })
+    .then([](int x) { return std::to_string(x); });
+    XCTAssertFalse(f.is_ready(), @"");
+    rxpromise::promise<int>* pp = &p;  // a promise is move-only
+    dispatch_async(dispatch_get_global_queue(0, 0), ^{
+        pp->set_value(21);
+    });
+    XCTAssertTrue(f.get() == "42", @"");
+}
+
+
+- (void) testFutureShouldPropagateExceptions {
+    
+    rxpromise::future<int> f = rxpromise::make_ready_future(1)
+    .then([](int) -> int { throw std::runtime_error("Failure"); })
+    .then([](int x) { return x + 1; })
+    .recover([](std::exception_ptr) { return -1; });
+    XCTAssertTrue(f.get() == -1, @"");
+}
+
+
+- (void) testFutureShouldBridgeToRXPromise {
+    
+    rxpromise::promise<int> p;
+    RXPromise* promise = rxpromise::make_rxpromise(p.get_future(), [](int x) { return @(x); });
+    p.set_value(7);
+    XCTAssertTrue([[promise get] isEqual:@7], @"");
+    
+    rxpromise::promise<int> failing;
+    RXPromise* rejected = rxpromise::make_rxpromise(failing.get_future(), [](int x) { return @(x); });
+    failing.set_error(std::make_error_code(std::errc::timed_out));
+    [rejected wait];
+    XCTAssertTrue(rejected.isRejected, @"");
+}
+
+
+- (void) testRXPromiseShouldBridgeToFuture {
+    
+    RXPromise* promise = [[RXPromise alloc] init];
+    rxpromise::future<NSUInteger> f = rxpromise::make_future(promise).then([](id value) {
+        return (NSUInteger)[value length];
+    });
+    [promise fulfillWithValue:@"abc"];
+    XCTAssertTrue(f.get() == 3, @"");
+    
+    RXPromise* cancelled = [[RXPromise alloc] init];
+    rxpromise::future<id> g = rxpromise::make_future(cancelled);
+    [cancelled cancel];
+    try {
+        g.get();
+        XCTFail(@"expected an exception");
+    }
+    catch (rxpromise::objc_error const& e) {
+        XCTAssertTrue(e.error.code == -1, @"");
+    }
+}
+
+
+- (void) testFutureThenShouldPassValue {
+    
+    rxpromise::promise<int> p;
+    rxpromise::future<int> f = p.get_future().then([](int x) { return x + 1; });
+    p.set_value(41);
+    XCTAssertTrue(f.get() == 42, @"");
+}
+
+
+- (void) testFutureThenShouldPassErrorWithoutInvokingContinuation {
+    
+    bool invoked = false;
+    rxpromise::promise<int> p;
+    rxpromise::future<int> f = p.get_future().then([&invoked](int x) { invoked = true; return x; });
+    p.set_error(std::make_error_code(std::errc::timed_out));
+    try {
+        f.get();
+        XCTFail(@"expected an exception");
+    }
+    catch (std::system_error const& e) {
+        XCTAssertTrue(e.code() == std::errc::timed_out, @"");
+    }
+    XCTAssertFalse(invoked, @"");
+}
+
+
+- (void) testFutureThenShouldSupportVoid {
+    
+    int count = 0;
+    rxpromise::promise<void> p;
+    rxpromise::future<int> f = p.get_future()
+    .then([&count]() { ++count; })
+    .then([&count]() { return count + 1; });
+    XCTAssertFalse(f.is_ready(), @"");
+    p.set_value();
+    XCTAssertTrue(f.get() == 2, @"");
+}
+
+
+- (void) testFutureThenShouldMoveMoveOnlyValues {
+    
+    rxpromise::promise<std::unique_ptr<int>> p;
+    rxpromise::future<std::unique_ptr<int>> f = p.get_future().then([](std::unique_ptr<int> value) {
+        *value += 1;
+        return value;
+    });
+    p.set_value(std::unique_ptr<int>(new int(41)));
+    std::unique_ptr<int> result = f.get();
+    XCTAssertTrue(result && *result == 42, @"");
+}
+
+
+- (void) testDestroyedPromiseShouldBreakFuture {
+    
+    rxpromise::future<int> f;
+    {
+        rxpromise::promise<int> p;
+        f = p.get_future().then([](int x) { return x + 1; });
+    }
+    try {
+        f.get();
+        XCTFail(@"expected an exception");
+    }
+    catch (std::future_error const& e) {
+        XCTAssertTrue(e.code() == std::future_errc::broken_promise, @"");
+    }
+}
+
+
+- (void) testFutureOfNilPromiseShouldBeRejected {
+    
+    rxpromise::future<id> f = rxpromise::make_future(nil);
+    XCTAssertTrue(f.is_ready(), @"");
+    try {
+        f.get();
+        XCTFail(@"expected an exception");
+    }
+    catch (std::future_error const& e) {
+        XCTAssertTrue(e.code() == std::future_errc::no_state, @"");
+    }
+}
+
+
+#pragma mark - Coroutines
+
+#if defined (RXPROMISE_EXPECT_COROUTINES) && !RXPROMISE_HAS_COROUTINES
+#error The coroutine tests require C++20 coroutines, see Tests/Configurations/Coroutines.xcconfig
+#endif
+
+#if RXPROMISE_HAS_COROUTINES
+
+static rxpromise::task addAsync(RXPromise* a, RXPromise* b) {
+    id x = co_await a;
+    id y = co_await rxpromise::resume_inline(b);
+    co_return @([x integerValue] + [y integerValue]);
+}
+
+static rxpromise::task recoverAsync(RXPromise* p) {
+    try {
+        co_await p;
+        co_return @"unexpected";
+    }
+    catch (rxpromise::objc_error const& e) {
+        co_return e.error.userInfo[NSLocalizedFailureReasonErrorKey];
+    }
+}
+
+static rxpromise::task forwardAsync(RXPromise* p) {
+    co_return co_await p;
+}
+
+static rxpromise::task resumeOnQueueAsync(RXPromise* p, dispatch_queue_t queue, void* key) {
+    co_await rxpromise::resume_on(p, queue);
+    co_return @(dispatch_get_specific(key) == key);
+}
+
+
+- (void) testCoroutineShouldAwaitPromisesInSequence {
+    
+    RXPromise* a = [RXPromise promiseWithTask:^id{ return @1; }];
+    RXPromise* b = [RXPromise promiseWithTask:^id{ return @2; }];
+    RXPromise* sum = addAsync(a, b);
+    XCTAssertTrue([[sum get] isEqual:@3], @"");
+}
+
+
+- (void) testCoroutineShouldThrowAndPropagateRejections {
+    
+    RXPromise* recovered = recoverAsync([RXPromise promiseWithTask:^id{ return [NSError errorWithDomain:@"Test" code:-1 userInfo:@{NSLocalizedFailureReasonErrorKey: @"Failure"}]; }]);
+    XCTAssertTrue([[recovered get] isEqual:@"Failure"], @"");
+    
+    RXPromise* rejected = forwardAsync([RXPromise promiseWithTask:^id{ return [NSError errorWithDomain:@"Test" code:-1 userInfo:nil]; }]);
+    [rejected wait];
+    XCTAssertTrue(rejected.isRejected, @"");
+    XCTAssertTrue([[rejected get] code] == -1, @"");
+}
+
+
+- (void) testCoroutineShouldResumeOnExecutionContext {
+    
+    static char key;
+    dispatch_queue_t queue = dispatch_queue_create("coroutine.test", NULL);
+    dispatch_queue_set_specific(queue, &key, &key, NULL);
+    RXPromise* promise = resumeOnQueueAsync([RXPromise promiseWithResult:@"OK"], queue, &key);
+    XCTAssertTrue([[promise get] boolValue], @"");
+}
+
 
+- (void) testCancellingCoroutineShouldCancelAwaitedPromise {
+    
+    RXPromise* awaited = [[RXPromise alloc] init];
+    RXPromise* promise = forwardAsync(awaited);
+    XCTAssertTrue(promise.isPending, @"");
+    [promise cancel];
+    [awaited wait];
+    XCTAssertTrue(awaited.isCancelled, @"");
+    [promise wait];
+    XCTAssertTrue(promise.isCancelled, @"");
+}
+
+#endif
 
 @end